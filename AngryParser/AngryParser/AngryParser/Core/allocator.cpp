@@ -1,5 +1,15 @@
 ﻿#include "allocator.h"
 
+#include <algorithm>
+#include <limits>
+#include <new>
+
+#include "exception.h"
+
+#if defined(__linux__)
+#include <sys/mman.h>
+#endif
+
 NS_BEGINE
 inline namespace Core
 {
@@ -9,36 +19,141 @@ inline namespace Core
 		clear();
 	}
 
-	void* Allocator::allocate(std::size_t size)
+	void* Allocator::allocate(std::size_t size, std::size_t alignment)
 	{
 		assert(size);
-		if (!lastBlock || (lastBlock->size - lastBlock->free) < size)
-			allocateBlock(size > (S - sizeof(Block)) ? size : (S - sizeof(Block)));
-		void* p = reinterpret_cast<char*>(lastBlock + 1) + lastBlock->free;
-		lastBlock->free += size;
+		assert(alignment && !(alignment & (alignment - 1)) && alignment <= alignof(std::max_align_t));
+		std::size_t offset = 0;
+		auto fits = [&](Block* block)
+		{
+			offset = (block->free + alignment - 1) & ~(alignment - 1);
+			return offset <= block->size && (block->size - offset) >= size;
+		};
+		// Blocks kept by reset() are reused before new ones are obtained
+		auto block = currentBlock;
+		while (block && !fits(block))
+			block = block->next;
+		if (!block)
+		{
+			// Grow geometrically, but no further than the limit if a smaller block will do
+			auto grow = std::min(std::min(std::max(reservedSize, S), G), getHeadroom());
+			allocateBlock(std::max(size, grow > sizeof(Block) ? grow - sizeof(Block) : 0));
+			block = lastBlock;
+			offset = 0;
+		}
+		currentBlock = block;
+		void* p = reinterpret_cast<char*>(block + 1) + offset;
+		usedSize += offset - block->free + size;
+		block->free = offset + size;
 		return p;
 	}
 
+	void* Allocator::allocateExact(std::size_t size)
+	{
+		assert(size);
+		auto block = currentBlock;
+		allocateBlock(size);
+		// Leave the current block where it was; the new one is full
+		currentBlock = block ? block : lastBlock;
+		lastBlock->free = size;
+		usedSize += size;
+		return lastBlock + 1;
+	}
+
 	void Allocator::deallocate(void* data, std::size_t size) noexcept
 	{
 		std::free(data);
 	}
 
+	void Allocator::reserve(std::size_t size)
+	{
+		std::size_t available = 0;
+		for (auto block = currentBlock; block; block = block->next)
+			available += block->size - block->free;
+		auto headroom = getHeadroom();
+		if (available < size && headroom > sizeof(Block))
+			allocateBlock(std::min(size - available, headroom - sizeof(Block)));
+		if (!currentBlock)
+			currentBlock = firstBlock;
+	}
+
 	void Allocator::clear()
 	{
-		for (auto p = firstBlock; p; ) { auto next = p->next; deallocate(p, sizeof(Block) + p->size); p = next; }
-		firstBlock = lastBlock = nullptr;
+		for (auto p = firstBlock; p; ) { auto next = p->next; freeBlock(p); p = next; }
+		firstBlock = lastBlock = currentBlock = nullptr;
+		usedSize = reservedSize = 0;
+	}
+
+	void Allocator::reset() noexcept
+	{
+		for (auto p = firstBlock; p; p = p->next)
+			p->free = 0;
+		currentBlock = firstBlock;
+		usedSize = 0;
 	}
 
 	void Allocator::allocateBlock(std::size_t size)
 	{
-		auto block = static_cast<Block*>(std::malloc(sizeof(Block) + size));
+		Block* block = nullptr;
+		auto length = sizeof(Block) + size;
+		bool mapped = false;
+		auto headroom = getHeadroom();
+		if (length < size || length > headroom)
+			throw LimitExceededException();
+#if defined(__linux__)
+		if (hugePages && length >= HugePage && ((length + HugePage - 1) & ~(HugePage - 1)) <= headroom)
+		{
+			length = (length + HugePage - 1) & ~(HugePage - 1);
+			auto p = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+			if (p == MAP_FAILED)
+			{
+				// No reserved huge pages; ask for transparent ones instead
+				p = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+				if (p != MAP_FAILED)
+					madvise(p, length, MADV_HUGEPAGE);
+			}
+			if (p != MAP_FAILED)
+			{
+				block = static_cast<Block*>(p);
+				mapped = true;
+			}
+			else
+				length = sizeof(Block) + size;
+		}
+#endif
+		if (!block)
+		{
+			block = static_cast<Block*>(std::malloc(length));
+			if (!block)
+				throw std::bad_alloc();
+		}
 		block->next = nullptr;
-		block->size = size;
+		block->size = length - sizeof(Block);
 		block->free = 0;
+		block->mapped = mapped;
+		reservedSize += length;
 		if (lastBlock) lastBlock->next = block, lastBlock = block;
 		else firstBlock = lastBlock = block;
 	}
 
+	std::size_t Allocator::getHeadroom() const noexcept
+	{
+		if (!limit)
+			return std::numeric_limits<std::size_t>::max();
+		return limit > reservedSize ? limit - reservedSize : 0;
+	}
+
+	void Allocator::freeBlock(Block* block) noexcept
+	{
+#if defined(__linux__)
+		if (block->mapped)
+		{
+			munmap(block, sizeof(Block) + block->size);
+			return;
+		}
+#endif
+		deallocate(block, sizeof(Block) + block->size);
+	}
+
 }
 NS_END
\ No newline at end of file
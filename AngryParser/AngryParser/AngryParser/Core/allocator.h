@@ -1,6 +1,8 @@
-﻿#ifndef _ALLOCATOR_H
+﻿#ifndef _ALLOCATOR_HPP
+#define _ALLOCATOR_HPP
 
 #include <cassert>
+#include <cstddef>
 #include <cstdlib>
 
 #include "compilerdetection.h"
@@ -12,32 +14,71 @@ inline namespace Core
 	{
 	public:
 
-		Allocator() = default;
+		Allocator() : firstBlock(), lastBlock(), currentBlock(), usedSize(), reservedSize(), limit(), hugePages() {}
 		Allocator(const Allocator& src) = delete;
 		~Allocator();
 
-		void* allocate(std::size_t size);
+		// alignment must be a power of two no greater than alignof(std::max_align_t)
+		void* allocate(std::size_t size, std::size_t alignment = alignof(std::max_align_t));
+
+		// Allocate size bytes from a block of exactly that size, aligned for any type
+		void* allocateExact(std::size_t size);
 
 		void deallocate(void* data, std::size_t size) noexcept;
 
+		// Make room for at least size more bytes with at most one new block, or for as many
+		// as the limit leaves
+		void reserve(std::size_t size);
+
+		// Most bytes that may be obtained from the system, block headers included, or 0 for
+		// no limit. Blocks stop growing at the limit, and an allocation that would pass it
+		// throws LimitExceededException. Blocks already obtained are kept.
+		void setLimit(std::size_t limit_) noexcept { limit = limit_; }
+		std::size_t getLimit() const noexcept { return limit; }
+
+		// Back blocks of HugePage bytes or more with huge pages where the system has them
+		// (Linux: MAP_HUGETLB, else transparent huge pages); other blocks come from malloc
+		void setHugePages(bool enabled) noexcept { hugePages = enabled; }
+
 		void clear();
 
+		// Forget every allocation but keep the blocks, which later allocations reuse
+		void reset() noexcept;
+
+		// Bytes handed out by allocate() and bytes obtained from malloc, block headers included
+		std::size_t getUsedSize() const noexcept { return usedSize; }
+		std::size_t getReservedSize() const noexcept { return reservedSize; }
+
 	private:
+		struct Block;
+
 		void allocateBlock(std::size_t size);
+		void freeBlock(Block* block) noexcept;
+		std::size_t getHeadroom() const noexcept;
 
 	private:
 
-		struct Block {
+		struct alignas(std::max_align_t) Block {
 
 			Block* next;
 			std::size_t size;
 			std::size_t free;
+			bool mapped;
 
 		};
 
+		// Blocks grow with the arena, from S up to G bytes, so that a large document takes
+		// a logarithmic number of them
 		const std::size_t S = 65536;
+		const std::size_t G = std::size_t(1) << 26;
+		const std::size_t HugePage = std::size_t(1) << 21;
 		Block* firstBlock;
 		Block* lastBlock;
+		Block* currentBlock;
+		std::size_t usedSize;
+		std::size_t reservedSize;
+		std::size_t limit;
+		bool hugePages;
 	};
 
 }
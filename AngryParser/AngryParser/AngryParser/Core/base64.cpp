@@ -0,0 +1,118 @@
+﻿#include "base64.h"
+
+#include <cstdint>
+
+NS_BEGINE
+inline namespace Core
+{
+	namespace
+	{
+		const std::uint32_t Invalid = 0x01000000;
+
+		// The 6-bit value of each character already shifted to its place in a group of
+		// four, or Invalid, so that a group is decoded by or-ing four lookups
+		struct Tables
+		{
+			std::uint32_t shifted[4][256];
+
+			constexpr Tables() noexcept : shifted()
+			{
+				const char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+				for (auto& table : shifted)
+				{
+					for (auto& entry : table)
+						entry = Invalid;
+				}
+				for (std::uint32_t i = 0; i < 64; ++i)
+				{
+					auto c = static_cast<unsigned char>(alphabet[i]);
+					shifted[0][c] = i << 18;
+					shifted[1][c] = i << 12;
+					shifted[2][c] = i << 6;
+					shifted[3][c] = i;
+				}
+			}
+		};
+
+		constexpr Tables tables;
+
+		bool isSpace(char c) noexcept
+		{
+			return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+		}
+	}
+
+	bool decodeBase64(const char* begin, const char* end, unsigned char* out, std::size_t& size) noexcept
+	{
+		auto& t = tables.shifted;
+		auto p = reinterpret_cast<const unsigned char*>(begin);
+		auto e = reinterpret_cast<const unsigned char*>(end);
+		auto q = out;
+		std::uint32_t group = 0;
+		int count = 0; // characters of group read so far
+		while (true)
+		{
+			// Whole groups, read before they are written so that decoding in place works
+			if (!count)
+			{
+				while (e - p >= 4)
+				{
+					auto v = t[0][p[0]] | t[1][p[1]] | t[2][p[2]] | t[3][p[3]];
+					if (v & Invalid)
+						break;
+					q[0] = static_cast<unsigned char>(v >> 16);
+					q[1] = static_cast<unsigned char>(v >> 8);
+					q[2] = static_cast<unsigned char>(v);
+					p += 4;
+					q += 3;
+				}
+			}
+			if (p == e)
+				break;
+			auto c = *p++;
+			if (isSpace(static_cast<char>(c)))
+				continue;
+			if (c == '=')
+			{
+				// One '=' after three characters or two after two, then only whitespace
+				if (count < 2)
+					return false;
+				if (count == 2)
+				{
+					while (p != e && isSpace(static_cast<char>(*p)))
+						++p;
+					if (p == e || *p++ != '=')
+						return false;
+				}
+				while (p != e && isSpace(static_cast<char>(*p)))
+					++p;
+				if (p != e)
+					return false;
+				group <<= 6 * (4 - count);
+				*q++ = static_cast<unsigned char>(group >> 16);
+				if (count == 3)
+					*q++ = static_cast<unsigned char>(group >> 8);
+				count = 0;
+				break;
+			}
+			auto v = t[3][c];
+			if (v & Invalid)
+				return false;
+			group = group << 6 | v;
+			if (++count == 4)
+			{
+				*q++ = static_cast<unsigned char>(group >> 16);
+				*q++ = static_cast<unsigned char>(group >> 8);
+				*q++ = static_cast<unsigned char>(group);
+				group = 0;
+				count = 0;
+			}
+		}
+		if (count)
+			return false;
+		size = q - out;
+		return true;
+	}
+
+}
+NS_END
@@ -0,0 +1,32 @@
+﻿#ifndef _BASE64_HPP
+#define _BASE64_HPP
+
+#include <cstddef>
+
+#include "compilerdetection.h"
+#include "string.h"
+
+NS_BEGINE
+inline namespace Core
+{
+
+// Most bytes that length characters of Base64 decode to
+inline std::size_t getBase64DecodedSize(std::size_t length) noexcept { return length / 4 * 3; }
+
+// Decode Base64 (RFC 4648, with padding) from [begin, end) into out, skipping the XML
+// whitespace that may separate any two characters, and set size to the number of bytes.
+// Groups of four characters are decoded through lookup tables without a branch per
+// character; whitespace and padding take a slower path. out needs room for
+// getBase64DecodedSize(end - begin) bytes and may be begin itself, which decodes in
+// place. Returns false if the input is not Base64, leaving out partly written.
+AngryParser_API bool decodeBase64(const char *begin, const char *end, unsigned char *out, std::size_t &size) noexcept;
+
+inline bool decodeBase64(StringView text, unsigned char *out, std::size_t &size) noexcept
+{
+    return decodeBase64(text.begin(), text.end(), out, size);
+}
+
+} // namespace Core
+NS_END
+
+#endif
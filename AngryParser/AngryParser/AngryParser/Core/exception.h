@@ -3,6 +3,7 @@
 
 #include <exception>
 #include <memory>
+#include <string>
 
 #include "compilerdetection.h"
 
@@ -16,33 +17,52 @@ inline namespace Core
 class Exception : public std::exception
 {
 private:
-    std::shared_ptr<const StringView> data;
+    std::shared_ptr<const std::string> data;
+    const char *message;
+
+protected:
+    struct StaticMessage
+    {
+    };
+
+    // message must have static storage duration; nothing is allocated
+    Exception(StaticMessage, const char *message_) noexcept : data(), message(message_) {}
+    Exception(const char *prefix, const StringView &data_) : data(std::make_shared<const std::string>(std::string(prefix).append(data_.getData(), data_.getLength()))), message(data->c_str()) {}
 
 public:
-    Exception(const StringView&data_) : data(std::make_shared<const StringView>(data_)) {}
+    Exception(const StringView &data_) : data(std::make_shared<const std::string>(data_.getData(), data_.getLength())), message(data->c_str()) {}
 
-    const char *what() const noexcept override { return data->getData(); }
+    const char *what() const noexcept override { return message; }
 };
 
 class InvalidArgumentException : public Exception
 {
 
 public:
-    InvalidArgumentException(const StringView&data) : Exception("InvalidArgumentException: " + data) {}
+    InvalidArgumentException(const StringView&data) : Exception("InvalidArgumentException: ", data) {}
 };
 
 class SystemException : public Exception
 {
 
 public:
-    SystemException(const StringView&data) : Exception("SystemException: " + data) {}
+    SystemException(const StringView&data) : Exception("SystemException: ", data) {}
 };
 
 class IOException : public Exception
 {
 
 public:
-    IOException(const StringView&data) : Exception("IOException: " + data) {}
+    IOException(const StringView&data) : Exception("IOException: ", data) {}
+};
+
+// Thrown when a limit set on an Allocator would be exceeded. The message is static, so
+// that throwing one when memory is short allocates nothing beyond the exception itself.
+class LimitExceededException : public Exception
+{
+
+public:
+    LimitExceededException() noexcept : Exception(StaticMessage(), "LimitExceededException: Allocator limit exceeded") {}
 };
 
 } // namespace Core
@@ -0,0 +1,158 @@
+﻿#include "file.h"
+
+#include <algorithm>
+
+#include "exception.h"
+
+#if defined(_WIN32)
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <cerrno>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+NS_BEGINE
+inline namespace Core
+{
+#if defined(_WIN32)
+	File::File(const char* path, Mode mode)
+	{
+		if (mode == Mode::Read)
+			handle = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+		else
+			handle = CreateFileA(path, GENERIC_READ | GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (handle == INVALID_HANDLE_VALUE)
+			throw IOException("Cannot open file");
+	}
+
+	File::~File()
+	{
+		CloseHandle(handle);
+	}
+
+	std::uint64_t File::getSize() const
+	{
+		LARGE_INTEGER size;
+		if (!GetFileSizeEx(handle, &size))
+			throw IOException("Cannot get file size");
+		return static_cast<std::uint64_t>(size.QuadPart);
+	}
+
+	void File::resize(std::uint64_t size)
+	{
+		LARGE_INTEGER position;
+		position.QuadPart = static_cast<LONGLONG>(size);
+		if (!SetFilePointerEx(handle, position, nullptr, FILE_BEGIN) || !SetEndOfFile(handle))
+			throw IOException("Cannot resize file");
+	}
+
+	std::size_t File::readAt(void* data, std::size_t n, std::uint64_t offset) const
+	{
+		std::size_t done = 0;
+		while (done < n)
+		{
+			OVERLAPPED overlapped = {};
+			overlapped.Offset = static_cast<DWORD>(offset + done);
+			overlapped.OffsetHigh = static_cast<DWORD>((offset + done) >> 32);
+			auto chunk = static_cast<DWORD>(std::min<std::size_t>(n - done, 1u << 30));
+			DWORD read;
+			if (!ReadFile(handle, static_cast<char*>(data) + done, chunk, &read, &overlapped))
+			{
+				if (GetLastError() == ERROR_HANDLE_EOF)
+					break;
+				throw IOException("Cannot read file");
+			}
+			if (!read)
+				break;
+			done += read;
+		}
+		return done;
+	}
+
+	void File::writeAt(const void* data, std::size_t n, std::uint64_t offset)
+	{
+		std::size_t done = 0;
+		while (done < n)
+		{
+			OVERLAPPED overlapped = {};
+			overlapped.Offset = static_cast<DWORD>(offset + done);
+			overlapped.OffsetHigh = static_cast<DWORD>((offset + done) >> 32);
+			auto chunk = static_cast<DWORD>(std::min<std::size_t>(n - done, 1u << 30));
+			DWORD written;
+			if (!WriteFile(handle, static_cast<const char*>(data) + done, chunk, &written, &overlapped))
+				throw IOException("Cannot write file");
+			done += written;
+		}
+	}
+#else
+	File::File(const char* path, Mode mode)
+	{
+		if (mode == Mode::Read)
+			fd = ::open(path, O_RDONLY | O_CLOEXEC);
+		else
+			fd = ::open(path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+		if (fd < 0)
+			throw IOException("Cannot open file");
+	}
+
+	File::~File()
+	{
+		::close(fd);
+	}
+
+	std::uint64_t File::getSize() const
+	{
+		struct stat st;
+		if (::fstat(fd, &st))
+			throw IOException("Cannot get file size");
+		return static_cast<std::uint64_t>(st.st_size);
+	}
+
+	void File::resize(std::uint64_t size)
+	{
+		if (::ftruncate(fd, static_cast<off_t>(size)))
+			throw IOException("Cannot resize file");
+	}
+
+	std::size_t File::readAt(void* data, std::size_t n, std::uint64_t offset) const
+	{
+		std::size_t done = 0;
+		while (done < n)
+		{
+			auto read = ::pread(fd, static_cast<char*>(data) + done, n - done, static_cast<off_t>(offset + done));
+			if (read < 0)
+			{
+				if (errno == EINTR)
+					continue;
+				throw IOException("Cannot read file");
+			}
+			if (!read)
+				break;
+			done += static_cast<std::size_t>(read);
+		}
+		return done;
+	}
+
+	void File::writeAt(const void* data, std::size_t n, std::uint64_t offset)
+	{
+		std::size_t done = 0;
+		while (done < n)
+		{
+			auto written = ::pwrite(fd, static_cast<const char*>(data) + done, n - done, static_cast<off_t>(offset + done));
+			if (written < 0)
+			{
+				if (errno == EINTR)
+					continue;
+				throw IOException("Cannot write file");
+			}
+			done += static_cast<std::size_t>(written);
+		}
+	}
+#endif
+
+}
+NS_END
@@ -0,0 +1,49 @@
+﻿#ifndef _FILE_HPP
+#define _FILE_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+#include "compilerdetection.h"
+
+NS_BEGINE
+inline namespace Core
+{
+
+// File accessed by offset, so that several threads can read or write it at once
+// without sharing a file position. Failures throw IOException.
+class AngryParser_API File
+{
+public:
+    enum class Mode
+    {
+        Read,
+        Write, // created, or truncated if it exists
+    };
+
+private:
+#if defined(_WIN32)
+    void *handle;
+#else
+    int fd;
+#endif
+
+public:
+    File(const char *path, Mode mode);
+    File(const File &src) = delete;
+    ~File();
+
+    File &operator=(const File &src) = delete;
+
+    std::uint64_t getSize() const;
+    void resize(std::uint64_t size);
+
+    // Read up to n bytes at offset; fewer are returned only at the end of the file
+    std::size_t readAt(void *data, std::size_t n, std::uint64_t offset) const;
+    void writeAt(const void *data, std::size_t n, std::uint64_t offset);
+};
+
+} // namespace Core
+NS_END
+
+#endif
@@ -0,0 +1,114 @@
+﻿#ifndef _HASH_HPP
+#define _HASH_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#include "compilerdetection.h"
+
+NS_BEGINE
+inline namespace Core
+{
+
+namespace Impl
+{
+
+constexpr std::uint64_t HashPrime1 = 0x9E3779B185EBCA87ULL;
+constexpr std::uint64_t HashPrime2 = 0xC2B2AE3D27D4EB4FULL;
+constexpr std::uint64_t HashPrime3 = 0x165667B19E3779F9ULL;
+constexpr std::uint64_t HashPrime4 = 0x85EBCA77C2B2AE63ULL;
+constexpr std::uint64_t HashPrime5 = 0x27D4EB2F165667C5ULL;
+
+inline std::uint64_t rotateLeft(std::uint64_t x, int r) noexcept { return (x << r) | (x >> (64 - r)); }
+
+inline std::uint64_t read64(const unsigned char *p) noexcept
+{
+    std::uint64_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+inline std::uint32_t read32(const unsigned char *p) noexcept
+{
+    std::uint32_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+inline std::uint64_t hashRound(std::uint64_t acc, std::uint64_t input) noexcept
+{
+    acc += input * HashPrime2;
+    acc = rotateLeft(acc, 31);
+    return acc * HashPrime1;
+}
+
+inline std::uint64_t hashMerge(std::uint64_t acc, std::uint64_t v) noexcept
+{
+    acc ^= hashRound(0, v);
+    return acc * HashPrime1 + HashPrime4;
+}
+
+} // namespace Impl
+
+// 64-bit XXH64-compatible hash. Inputs of 32 bytes or more are consumed by four
+// independent lanes, which the compiler keeps in registers (and can vectorize).
+inline std::uint64_t hashBytes(const void *data, std::size_t length, std::uint64_t seed = 0) noexcept
+{
+    using namespace Impl;
+
+    auto p = static_cast<const unsigned char *>(data);
+    auto end = p + length;
+    std::uint64_t h;
+
+    if (length >= 32)
+    {
+        std::uint64_t v1 = seed + HashPrime1 + HashPrime2;
+        std::uint64_t v2 = seed + HashPrime2;
+        std::uint64_t v3 = seed;
+        std::uint64_t v4 = seed - HashPrime1;
+        for (auto limit = end - 32; p <= limit; p += 32)
+        {
+            v1 = hashRound(v1, read64(p));
+            v2 = hashRound(v2, read64(p + 8));
+            v3 = hashRound(v3, read64(p + 16));
+            v4 = hashRound(v4, read64(p + 24));
+        }
+        h = rotateLeft(v1, 1) + rotateLeft(v2, 7) + rotateLeft(v3, 12) + rotateLeft(v4, 18);
+        h = hashMerge(h, v1);
+        h = hashMerge(h, v2);
+        h = hashMerge(h, v3);
+        h = hashMerge(h, v4);
+    }
+    else
+        h = seed + HashPrime5;
+
+    h += static_cast<std::uint64_t>(length);
+
+    for (; p + 8 <= end; p += 8)
+        h = rotateLeft(h ^ hashRound(0, read64(p)), 27) * HashPrime1 + HashPrime4;
+    if (p + 4 <= end)
+    {
+        h = rotateLeft(h ^ (static_cast<std::uint64_t>(read32(p)) * HashPrime1), 23) * HashPrime2 + HashPrime3;
+        p += 4;
+    }
+    for (; p != end; ++p)
+        h = rotateLeft(h ^ (*p * HashPrime5), 11) * HashPrime1;
+
+    h ^= h >> 33;
+    h *= HashPrime2;
+    h ^= h >> 29;
+    h *= HashPrime3;
+    h ^= h >> 32;
+    return h;
+}
+
+inline std::uint64_t hashCombine(std::uint64_t seed, std::uint64_t value) noexcept
+{
+    return Impl::hashMerge(seed ^ Impl::rotateLeft(value, 17), value);
+}
+
+} // namespace Core
+NS_END
+
+#endif
@@ -0,0 +1,346 @@
+﻿#include "number.h"
+
+#include <cerrno>
+#include <clocale>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <string>
+#include <type_traits>
+
+NS_BEGINE
+inline namespace Core
+{
+	namespace
+	{
+		bool isSpace(char c) noexcept
+		{
+			return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+		}
+		bool isDigit(char c) noexcept
+		{
+			return static_cast<unsigned char>(c - '0') < 10;
+		}
+
+		// Value of the eight digits at p, or false if they are not all digits
+		bool parseEightDigits(const char* p, std::uint64_t& value) noexcept
+		{
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+			return false;
+#else
+			std::uint64_t w;
+			std::memcpy(&w, p, 8);
+			if (((w & 0xF0F0F0F0F0F0F0F0ull) | (((w + 0x0606060606060606ull) & 0xF0F0F0F0F0F0F0F0ull) >> 4)) != 0x3333333333333333ull)
+				return false;
+			// Combine neighbouring digits, then pairs of those, then pairs of those
+			w -= 0x3030303030303030ull;
+			w = w * 10 + (w >> 8);
+			value = (((w & 0x000000FF000000FFull) * (100 + (1000000ull << 32))) + (((w >> 16) & 0x000000FF000000FFull) * (1 + (10000ull << 32)))) >> 32;
+			return true;
+#endif
+		}
+
+		template <typename T>
+		const char* parseInteger(const char* p, const char* end, T& value) noexcept
+		{
+			using U = unsigned long long;
+			bool negative = false;
+			if (p != end && (*p == '+' || *p == '-'))
+				negative = *p++ == '-';
+			if (p == end || !isDigit(*p))
+				return nullptr;
+			auto limit = static_cast<U>(std::numeric_limits<T>::max());
+			if (negative && std::is_signed<T>::value)
+				++limit;
+			U v = 0;
+			std::uint64_t eight;
+			while (end - p >= 8 && parseEightDigits(p, eight))
+			{
+				if (v > (limit - eight) / 100000000)
+					return nullptr;
+				v = v * 100000000 + eight;
+				p += 8;
+			}
+			for (; p != end && isDigit(*p); ++p)
+			{
+				U digit = *p - '0';
+				if (v > (limit - digit) / 10)
+					return nullptr;
+				v = v * 10 + digit;
+			}
+			if (!negative)
+				value = static_cast<T>(v);
+			else if (!v)
+				value = 0;
+			else if (std::is_signed<T>::value)
+				value = static_cast<T>(-static_cast<T>(v - 1) - 1);
+			else
+				return nullptr;
+			return p;
+		}
+
+		// Up to 19 significant digits, which fit 64 bits, and a power of ten
+		struct Decimal
+		{
+			std::uint64_t mantissa;
+			int exponent;
+			int digits;
+			bool negative;
+			bool truncated; // nonzero digits were dropped
+		};
+
+		const char* scanDigits(const char* p, const char* end, Decimal& d, bool fraction, bool& any) noexcept
+		{
+			// Once a block of eight fails, fewer than eight digits are left
+			std::uint64_t eight;
+			while (d.digits <= 11 && end - p >= 8 && parseEightDigits(p, eight))
+			{
+				d.mantissa = d.mantissa * 100000000 + eight;
+				d.digits += 8;
+				if (fraction)
+					d.exponent -= 8;
+				p += 8;
+				any = true;
+			}
+			for (; p != end && isDigit(*p); ++p)
+			{
+				if (d.digits < 19)
+				{
+					d.mantissa = d.mantissa * 10 + (*p - '0');
+					++d.digits;
+					if (fraction)
+						--d.exponent;
+				}
+				else
+				{
+					if (!fraction)
+						++d.exponent;
+					d.truncated |= *p != '0';
+				}
+				any = true;
+			}
+			return p;
+		}
+
+		const char* scanDecimal(const char* p, const char* end, Decimal& d) noexcept
+		{
+			d = Decimal();
+			if (p != end && (*p == '+' || *p == '-'))
+				d.negative = *p++ == '-';
+			bool any = false;
+			while (p != end && *p == '0')
+			{
+				++p;
+				any = true;
+			}
+			p = scanDigits(p, end, d, false, any);
+			if (p != end && *p == '.')
+			{
+				++p;
+				if (!d.mantissa)
+				{
+					while (p != end && *p == '0')
+					{
+						++p;
+						--d.exponent;
+						any = true;
+					}
+				}
+				p = scanDigits(p, end, d, true, any);
+			}
+			if (!any)
+				return nullptr;
+			if (p != end && (*p == 'e' || *p == 'E'))
+			{
+				++p;
+				bool negative = false;
+				if (p != end && (*p == '+' || *p == '-'))
+					negative = *p++ == '-';
+				if (p == end || !isDigit(*p))
+					return nullptr;
+				int e = 0;
+				for (; p != end && isDigit(*p); ++p)
+				{
+					if (e < 100000)
+						e = e * 10 + (*p - '0');
+				}
+				d.exponent += negative ? -e : e;
+			}
+			return p;
+		}
+
+		// INF, -INF, +INF or NaN; returns the end or nullptr
+		template <typename T>
+		const char* scanSpecial(const char* p, const char* end, T& value) noexcept
+		{
+			bool negative = false;
+			auto q = p;
+			if (q != end && (*q == '+' || *q == '-'))
+				negative = *q++ == '-';
+			if (end - q >= 3 && !std::memcmp(q, "INF", 3))
+			{
+				value = negative ? -std::numeric_limits<T>::infinity() : std::numeric_limits<T>::infinity();
+				return q + 3;
+			}
+			if (q == p && end - q >= 3 && !std::memcmp(q, "NaN", 3))
+			{
+				value = std::numeric_limits<T>::quiet_NaN();
+				return q + 3;
+			}
+			return nullptr;
+		}
+
+		// Correctly rounded conversion by the C library, for what the fast paths cannot do
+		template <typename T>
+		bool convertSlow(const char* begin, const char* end, T& value)
+		{
+			std::string text(begin, end);
+			auto point = std::localeconv()->decimal_point;
+			if (point && *point && *point != '.')
+			{
+				for (auto& c : text)
+				{
+					if (c == '.')
+						c = *point;
+				}
+			}
+			errno = 0;
+			char* stop;
+			T result = std::is_same<T, float>::value ? static_cast<T>(std::strtof(text.c_str(), &stop)) : static_cast<T>(std::strtod(text.c_str(), &stop));
+			if (stop != text.c_str() + text.size() || (errno == ERANGE && std::isinf(result)))
+				return false;
+			value = result;
+			return true;
+		}
+
+		const double powersOf10[] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+		const float powersOf10f[] = {1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f, 1e6f, 1e7f, 1e8f, 1e9f, 1e10f};
+
+		// Clinger's fast path: the mantissa and the power of ten are both exact, so one
+		// rounding gives the correctly rounded result
+		bool convertFast(const Decimal& d, double& value) noexcept
+		{
+			if (!d.mantissa)
+			{
+				value = d.negative ? -0.0 : 0.0;
+				return true;
+			}
+			if (d.truncated || d.mantissa > (std::uint64_t(1) << 53) || d.exponent < -22 || d.exponent > 22)
+				return false;
+			auto v = static_cast<double>(d.mantissa);
+			v = d.exponent < 0 ? v / powersOf10[-d.exponent] : v * powersOf10[d.exponent];
+			value = d.negative ? -v : v;
+			return true;
+		}
+
+		const char* parseFloating(const char* begin, const char* end, double& value) noexcept
+		{
+			Decimal d;
+			auto p = scanDecimal(begin, end, d);
+			if (!p)
+				return scanSpecial(begin, end, value);
+			if (convertFast(d, value))
+				return p;
+			try
+			{
+				return convertSlow(begin, p, value) ? p : nullptr;
+			}
+			catch (...)
+			{
+				return nullptr;
+			}
+		}
+
+		const char* parseFloating(const char* begin, const char* end, float& value) noexcept
+		{
+			Decimal d;
+			auto p = scanDecimal(begin, end, d);
+			if (!p)
+				return scanSpecial(begin, end, value);
+			if (!d.truncated && d.mantissa <= (std::uint64_t(1) << 24) && d.exponent >= -10 && d.exponent <= 10)
+			{
+				auto v = static_cast<float>(d.mantissa);
+				v = d.exponent < 0 ? v / powersOf10f[-d.exponent] : v * powersOf10f[d.exponent];
+				value = d.negative ? -v : v;
+				return p;
+			}
+			// Rounding the correctly rounded double again is right unless it fell exactly
+			// halfway between two floats, which shows in the 29 bits a float does not keep
+			double wide;
+			if (convertFast(d, wide) && std::fabs(wide) >= std::numeric_limits<float>::min() && std::fabs(wide) <= std::numeric_limits<float>::max())
+			{
+				std::uint64_t bits;
+				std::memcpy(&bits, &wide, sizeof(bits));
+				if ((bits & 0x1FFFFFFF) != 0x10000000)
+				{
+					value = static_cast<float>(wide);
+					return p;
+				}
+			}
+			try
+			{
+				return convertSlow(begin, p, value) ? p : nullptr;
+			}
+			catch (...)
+			{
+				return nullptr;
+			}
+		}
+
+		template <typename T>
+		const char* parseValue(const char* begin, const char* end, T& value) noexcept
+		{
+			return parseInteger(begin, end, value);
+		}
+		const char* parseValue(const char* begin, const char* end, float& value) noexcept
+		{
+			return parseFloating(begin, end, value);
+		}
+		const char* parseValue(const char* begin, const char* end, double& value) noexcept
+		{
+			return parseFloating(begin, end, value);
+		}
+
+		template <typename T>
+		const char* parseList(const char* p, const char* end, T* out, std::size_t& count) noexcept
+		{
+			std::size_t n = 0;
+			while (true)
+			{
+				while (p != end && isSpace(*p))
+					++p;
+				if (p == end || n == count)
+					break;
+				auto q = parseValue(p, end, out[n]);
+				if (!q || (q != end && !isSpace(*q)))
+					break;
+				p = q;
+				++n;
+			}
+			count = n;
+			return p;
+		}
+	}
+
+	const char* parseNumber(const char* begin, const char* end, int& value) noexcept { return parseValue(begin, end, value); }
+	const char* parseNumber(const char* begin, const char* end, unsigned int& value) noexcept { return parseValue(begin, end, value); }
+	const char* parseNumber(const char* begin, const char* end, long& value) noexcept { return parseValue(begin, end, value); }
+	const char* parseNumber(const char* begin, const char* end, unsigned long& value) noexcept { return parseValue(begin, end, value); }
+	const char* parseNumber(const char* begin, const char* end, long long& value) noexcept { return parseValue(begin, end, value); }
+	const char* parseNumber(const char* begin, const char* end, unsigned long long& value) noexcept { return parseValue(begin, end, value); }
+	const char* parseNumber(const char* begin, const char* end, float& value) noexcept { return parseValue(begin, end, value); }
+	const char* parseNumber(const char* begin, const char* end, double& value) noexcept { return parseValue(begin, end, value); }
+
+	const char* parseNumbers(const char* begin, const char* end, int* out, std::size_t& count) noexcept { return parseList(begin, end, out, count); }
+	const char* parseNumbers(const char* begin, const char* end, unsigned int* out, std::size_t& count) noexcept { return parseList(begin, end, out, count); }
+	const char* parseNumbers(const char* begin, const char* end, long* out, std::size_t& count) noexcept { return parseList(begin, end, out, count); }
+	const char* parseNumbers(const char* begin, const char* end, unsigned long* out, std::size_t& count) noexcept { return parseList(begin, end, out, count); }
+	const char* parseNumbers(const char* begin, const char* end, long long* out, std::size_t& count) noexcept { return parseList(begin, end, out, count); }
+	const char* parseNumbers(const char* begin, const char* end, unsigned long long* out, std::size_t& count) noexcept { return parseList(begin, end, out, count); }
+	const char* parseNumbers(const char* begin, const char* end, float* out, std::size_t& count) noexcept { return parseList(begin, end, out, count); }
+	const char* parseNumbers(const char* begin, const char* end, double* out, std::size_t& count) noexcept { return parseList(begin, end, out, count); }
+
+}
+NS_END
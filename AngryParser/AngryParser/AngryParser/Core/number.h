@@ -0,0 +1,59 @@
+﻿#ifndef _NUMBER_HPP
+#define _NUMBER_HPP
+
+#include <cstddef>
+
+#include "compilerdetection.h"
+#include "string.h"
+
+NS_BEGINE
+inline namespace Core
+{
+
+// Numbers in the lexical form of XML Schema: an optional sign and decimal digits, which
+// for floating point types may have a fraction and an exponent or be INF, -INF or NaN.
+// Floating point results are correctly rounded, like strtod, but most take a fast path
+// that reads eight digits at a time and needs no library call. A number that does not fit
+// the type is an error.
+
+// Parse the number at begin, which must not be preceded by whitespace. Returns the end of
+// the number, or nullptr if there is none there or it does not fit.
+AngryParser_API const char *parseNumber(const char *begin, const char *end, int &value) noexcept;
+AngryParser_API const char *parseNumber(const char *begin, const char *end, unsigned int &value) noexcept;
+AngryParser_API const char *parseNumber(const char *begin, const char *end, long &value) noexcept;
+AngryParser_API const char *parseNumber(const char *begin, const char *end, unsigned long &value) noexcept;
+AngryParser_API const char *parseNumber(const char *begin, const char *end, long long &value) noexcept;
+AngryParser_API const char *parseNumber(const char *begin, const char *end, unsigned long long &value) noexcept;
+AngryParser_API const char *parseNumber(const char *begin, const char *end, float &value) noexcept;
+AngryParser_API const char *parseNumber(const char *begin, const char *end, double &value) noexcept;
+
+// Parse whitespace-separated numbers from [begin, end) into out, which has room for count
+// of them, and set count to how many were stored. Returns where parsing stopped: end if
+// all of the input was read, otherwise the start of the first number that was not stored,
+// because out was full or it is not a number of that type.
+AngryParser_API const char *parseNumbers(const char *begin, const char *end, int *out, std::size_t &count) noexcept;
+AngryParser_API const char *parseNumbers(const char *begin, const char *end, unsigned int *out, std::size_t &count) noexcept;
+AngryParser_API const char *parseNumbers(const char *begin, const char *end, long *out, std::size_t &count) noexcept;
+AngryParser_API const char *parseNumbers(const char *begin, const char *end, unsigned long *out, std::size_t &count) noexcept;
+AngryParser_API const char *parseNumbers(const char *begin, const char *end, long long *out, std::size_t &count) noexcept;
+AngryParser_API const char *parseNumbers(const char *begin, const char *end, unsigned long long *out, std::size_t &count) noexcept;
+AngryParser_API const char *parseNumbers(const char *begin, const char *end, float *out, std::size_t &count) noexcept;
+AngryParser_API const char *parseNumbers(const char *begin, const char *end, double *out, std::size_t &count) noexcept;
+
+// The whole of text, apart from surrounding whitespace, must be one number
+template <typename T>
+bool parseNumber(StringView text, T &value) noexcept
+{
+    auto isSpace = [](char c) { return c == ' ' || c == '\t' || c == '\n' || c == '\r'; };
+    auto begin = text.begin(), end = text.end();
+    while (begin != end && isSpace(*begin))
+        ++begin;
+    while (end != begin && isSpace(end[-1]))
+        --end;
+    return parseNumber(begin, end, value) == end && begin != end;
+}
+
+} // namespace Core
+NS_END
+
+#endif
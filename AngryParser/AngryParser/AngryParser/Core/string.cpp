@@ -1 +1,14 @@
-﻿#include "string.h"
\ No newline at end of file
+﻿#include "string.h"
+
+NS_BEGINE
+inline namespace Core
+{
+	namespace Impl
+	{
+		bool equalLongChar(const char* a, const char* b, std::size_t length) noexcept
+		{
+			return !std::memcmp(a, b, length);
+		}
+	}
+}
+NS_END
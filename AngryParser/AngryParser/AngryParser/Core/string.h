@@ -2,31 +2,62 @@
 #define STRING_HPP
 
 #include <cstddef>
+#include <cstdint>
+#include <cstring>
 
 #include <algorithm>
 #include <iostream>
 #include <string>
 
 #include "compilerdetection.h"
+#include "hash.h"
 
 NS_BEGINE
 inline namespace Core
 {
 
-static int compareChar(const char *begin1, const char *end1, const char *begin2, const char *end2) noexcept
+namespace Impl
 {
 
-    using U = std::make_unsigned_t<char>;
-    for (auto p = begin1, q = begin2;; ++p, ++q)
+// Ranges longer than 32 bytes, compared by memcmp, which the C library vectorizes
+AngryParser_API bool equalLongChar(const char *a, const char *b, std::size_t length) noexcept;
+
+// Equality of two ranges of length bytes, compared a machine word at a time; the last word
+// overlaps the one before it instead of falling back to single bytes. Names and most values
+// are short enough for one or two loads a side.
+inline bool equalChar(const char *a, const char *b, std::size_t length) noexcept
+{
+    if (length > 32)
+        return equalLongChar(a, b, length);
+    auto p = reinterpret_cast<const unsigned char *>(a), q = reinterpret_cast<const unsigned char *>(b);
+    if (length >= 8)
     {
+        for (std::size_t i = 0; i + 8 < length; i += 8)
+            if (read64(p + i) != read64(q + i))
+                return false;
+        return read64(p + length - 8) == read64(q + length - 8);
+    }
+    if (length >= 4)
+        return read32(p) == read32(q) && read32(p + length - 4) == read32(q + length - 4);
+    if (!length)
+        return true;
+    return p[0] == q[0] && p[length >> 1] == q[length >> 1] && p[length - 1] == q[length - 1];
+}
+
+} // namespace Impl
+
+static int compareChar(const char *begin1, const char *end1, const char *begin2, const char *end2) noexcept
+{
 
-        bool m1 = p == end1, m2 = q == end2;
-        if (m1 || m2)
-            return m2 - m1;
-        char c1 = *p, c2 = *q;
-        if (c1 != c2)
-            return U(c1) < U(c2) ? -1 : 1;
+    std::size_t length1 = end1 - begin1, length2 = end2 - begin2;
+    if (auto length = std::min(length1, length2))
+    {
+        // memcmp orders bytes as unsigned char, as the byte loop it replaces did
+        int r = std::memcmp(begin1, begin2, length);
+        if (r)
+            return r < 0 ? -1 : 1;
     }
+    return length1 < length2 ? -1 : length1 > length2;
 }
 
 static std::size_t getCharLength(const char *str) noexcept
@@ -82,12 +113,7 @@ public:
     friend bool operator==(const StringView &a, const StringView &b) noexcept
     {
 
-        if (a.length != b.length)
-            return false;
-        for (auto p = a.data, q = b.data, end = p + a.length; p != end; ++p, ++q)
-            if (*p != *q)
-                return false;
-        return true;
+        return a.length == b.length && Impl::equalChar(a.data, b.data, a.length);
     }
     friend bool operator!=(const StringView &a, const StringView &b) noexcept { return !(a == b); }
     friend bool operator<(const StringView &a, const StringView &b) noexcept { return compareChar(a.data, a.data + a.length, b.data, b.data + b.length) < 0; }
@@ -111,10 +137,64 @@ public:
 
     bool isEmpty() const noexcept { return !length; }
 
+    // hashBytes of the characters; views that compare equal hash equal
+    std::uint64_t getHash(std::uint64_t seed = 0) const noexcept { return hashBytes(data, length, seed); }
+
     Iterator begin() const noexcept { return data; }
     Iterator end() const noexcept { return data + length; }
 };
 
+// A view together with its hash, computed once when it is made. Use it where one string is
+// looked up or compared many times: unequal strings almost always differ in the hash, which
+// is compared before any characters are.
+class AngryParser_API HashedStringView
+{
+
+public:
+    using CharType = StringView::CharType;
+
+    using Iterator = StringView::Iterator;
+    using ConstIterator = Iterator;
+
+private:
+    StringView view;
+    std::uint64_t hash;
+
+public:
+    HashedStringView() noexcept : view(), hash(view.getHash()) {}
+    HashedStringView(StringView view_) noexcept : view(view_), hash(view_.getHash()) {}
+    HashedStringView(const CharType *data_) noexcept : HashedStringView(StringView(data_)) {}
+    HashedStringView(const CharType *data_, std::size_t length_) noexcept : HashedStringView(StringView(data_, length_)) {}
+    // For a hash already known to be view.getHash()
+    HashedStringView(StringView view_, std::uint64_t hash_) noexcept : view(view_), hash(hash_) {}
+    HashedStringView(const HashedStringView &src) noexcept = default;
+    ~HashedStringView() = default;
+
+    HashedStringView &operator=(const HashedStringView &src) = default;
+
+    operator StringView() const noexcept { return view; }
+    const CharType &operator[](std::size_t index) const noexcept { return view[index]; }
+
+    friend bool operator==(const HashedStringView &a, const HashedStringView &b) noexcept { return a.hash == b.hash && a.view == b.view; }
+    friend bool operator!=(const HashedStringView &a, const HashedStringView &b) noexcept { return !(a == b); }
+    friend bool operator<(const HashedStringView &a, const HashedStringView &b) noexcept { return a.view < b.view; }
+    friend bool operator>(const HashedStringView &a, const HashedStringView &b) noexcept { return a.view > b.view; }
+    friend bool operator<=(const HashedStringView &a, const HashedStringView &b) noexcept { return a.view <= b.view; }
+    friend bool operator>=(const HashedStringView &a, const HashedStringView &b) noexcept { return a.view >= b.view; }
+
+    friend std::basic_ostream<CharType> &operator<<(std::basic_ostream<CharType> &stream, const HashedStringView &sv) { return stream << sv.view; }
+
+    StringView getView() const noexcept { return view; }
+    std::uint64_t getHash() const noexcept { return hash; }
+    const CharType *getData() const noexcept { return view.getData(); }
+    std::size_t getLength() const noexcept { return view.getLength(); }
+
+    bool isEmpty() const noexcept { return view.isEmpty(); }
+
+    Iterator begin() const noexcept { return view.begin(); }
+    Iterator end() const noexcept { return view.end(); }
+};
+
 inline namespace StringViewLiteral
 {
 
@@ -125,4 +205,21 @@ constexpr StringView operator"" _sv(const char *data, std::size_t length) noexce
 } // namespace Core
 NS_END
 
+namespace std
+{
+
+template <>
+struct hash<AngryParser::StringView>
+{
+    std::size_t operator()(const AngryParser::StringView &sv) const noexcept { return static_cast<std::size_t>(sv.getHash()); }
+};
+
+template <>
+struct hash<AngryParser::HashedStringView>
+{
+    std::size_t operator()(const AngryParser::HashedStringView &sv) const noexcept { return static_cast<std::size_t>(sv.getHash()); }
+};
+
+} // namespace std
+
 #endif
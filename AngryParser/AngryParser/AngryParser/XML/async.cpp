@@ -0,0 +1 @@
+﻿#include "async.h"
@@ -0,0 +1,176 @@
+﻿#ifndef _ASYNC_HPP
+#define _ASYNC_HPP
+
+#include "../Core/compilerdetection.h"
+
+// Requires C++20 coroutines (/std:c++latest with MSVC); otherwise this header is empty
+#if defined(__cpp_impl_coroutine) && __cpp_impl_coroutine >= 201902L
+
+#include <cassert>
+#include <cstddef>
+
+#include <coroutine>
+#include <exception>
+#include <utility>
+
+#include "stream.h"
+
+NS_BEGINE
+inline namespace XML
+{
+
+// Lazily started coroutine that resumes its awaiter when done
+template <typename T>
+class XMLTask
+{
+public:
+    struct promise_type
+    {
+        T value;
+        std::exception_ptr exception;
+        std::coroutine_handle<> continuation;
+
+        struct FinalAwaiter
+        {
+            bool await_ready() const noexcept { return false; }
+            std::coroutine_handle<> await_suspend(std::coroutine_handle<promise_type> h) noexcept { return h.promise().continuation; }
+            void await_resume() const noexcept {}
+        };
+
+        XMLTask get_return_object() noexcept { return XMLTask(std::coroutine_handle<promise_type>::from_promise(*this)); }
+        std::suspend_always initial_suspend() const noexcept { return {}; }
+        FinalAwaiter final_suspend() const noexcept { return {}; }
+        void return_value(T value_) { value = std::move(value_); }
+        void unhandled_exception() noexcept { exception = std::current_exception(); }
+    };
+
+private:
+    std::coroutine_handle<promise_type> handle;
+
+    explicit XMLTask(std::coroutine_handle<promise_type> handle_) noexcept : handle(handle_) {}
+
+public:
+    XMLTask() noexcept : handle() {}
+    XMLTask(XMLTask &&src) noexcept : handle(std::exchange(src.handle, nullptr)) {}
+    XMLTask(const XMLTask &src) = delete;
+    ~XMLTask()
+    {
+        if (handle)
+            handle.destroy();
+    }
+
+    XMLTask &operator=(XMLTask &&src) noexcept
+    {
+        if (this != &src)
+        {
+            if (handle)
+                handle.destroy();
+            handle = std::exchange(src.handle, nullptr);
+        }
+        return *this;
+    }
+
+    bool await_ready() const noexcept { return false; }
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> continuation) noexcept
+    {
+        handle.promise().continuation = continuation;
+        return handle;
+    }
+    T await_resume()
+    {
+        if (handle.promise().exception)
+            std::rethrow_exception(handle.promise().exception);
+        return std::move(handle.promise().value);
+    }
+};
+
+// Coroutine front-end for XMLStreamReader: co_await next() yields one token at a time,
+// co_await-ing source.read(data, size) whenever the buffered input runs dry. read must
+// return an awaitable producing the number of bytes written to data, 0 at the end of
+// the input. A token already in the buffer is produced without suspending, so the
+// coroutine machinery is only involved once per chunk read. Errors throw
+// XMLParseException out of co_await next().
+template <typename Source, XMLParser::Flag F = XMLParser::Flag::Default>
+class XMLAsyncReader
+{
+public:
+    using TokenType = typename XMLStreamReader<F>::TokenType;
+    using Attribute = typename XMLStreamReader<F>::Attribute;
+    using Status = typename XMLStreamReader<F>::Status;
+
+    class NextAwaiter
+    {
+    public:
+        NextAwaiter(XMLAsyncReader *reader_) noexcept : reader(reader_), status(), task() {}
+
+        bool await_ready()
+        {
+            status = reader->stream.next();
+            return status != Status::NeedData;
+        }
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<> continuation)
+        {
+            task = reader->fill();
+            return task.await_suspend(continuation);
+        }
+        bool await_resume()
+        {
+            if (status == Status::NeedData)
+                return task.await_resume();
+            return status == Status::Token;
+        }
+
+    private:
+        XMLAsyncReader *reader;
+        Status status;
+        XMLTask<bool> task;
+    };
+
+private:
+    Source &source;
+    std::size_t chunk;
+    XMLStreamReader<F> stream;
+
+    XMLTask<bool> fill()
+    {
+        while (true)
+        {
+            auto data = stream.prepare(chunk);
+            std::size_t n = co_await source.read(data, chunk);
+            if (n)
+                stream.commit(n);
+            else
+                stream.finish();
+            auto status = stream.next();
+            if (status != Status::NeedData)
+                co_return status == Status::Token;
+        }
+    }
+
+public:
+    XMLAsyncReader(Source &source_, std::size_t chunk_ = 65536) : source(source_), chunk(chunk_), stream()
+    {
+        assert(chunk);
+    }
+    XMLAsyncReader(const XMLAsyncReader &src) = delete;
+
+    XMLAsyncReader &operator=(const XMLAsyncReader &src) = delete;
+
+    // co_await next() is true with a token and false at the end of the document
+    NextAwaiter next() noexcept { return NextAwaiter(this); }
+
+    TokenType tokenType() const noexcept { return stream.tokenType(); }
+    StringView name() const noexcept { return stream.name(); }
+    StringView value() const noexcept { return stream.value(); }
+    bool isEmptyElement() const noexcept { return stream.isEmptyElement(); }
+    std::size_t depth() const noexcept { return stream.depth(); }
+    const std::vector<Attribute> &attributes() const noexcept { return stream.attributes(); }
+    std::size_t getOffset() const noexcept { return stream.getOffset(); }
+};
+
+} // namespace XML
+NS_END
+
+#endif
+
+#endif
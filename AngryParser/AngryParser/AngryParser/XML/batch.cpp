@@ -0,0 +1,299 @@
+﻿#include "batch.h"
+
+#include <algorithm>
+#include <utility>
+
+#include "../Core/exception.h"
+#include "../Core/file.h"
+
+NS_BEGINE
+inline namespace XML
+{
+	XMLBatchParser::XMLBatchParser(std::size_t threads_) : queues(), workerSlots(), threads(), mutex(), wake(), done(), job(), generation(), pending(), next(), count(), mode(), active(), exception(), stop(), orderedSlots(), progress(), delivered(), arrivals(), submittedData(), submittedCount(), closed(), arrived()
+	{
+		if (!threads_)
+			threads_ = std::max<std::size_t>(1, std::thread::hardware_concurrency());
+		for (std::size_t i = 0; i < threads_; ++i)
+		{
+			queues.emplace_back(new Queue());
+			workerSlots.emplace_back(new Slot());
+		}
+		for (std::size_t i = 0; i < threads_; ++i)
+			threads.emplace_back(&XMLBatchParser::work, this, i);
+	}
+
+	XMLBatchParser::~XMLBatchParser()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stop = true;
+		}
+		wake.notify_all();
+		for (auto& thread : threads)
+			thread.join();
+	}
+
+	void XMLBatchParser::work(std::size_t worker)
+	{
+		std::size_t seen = 0;
+		while (true)
+		{
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				wake.wait(lock, [&] { return stop || generation != seen; });
+				if (stop)
+					return;
+				seen = generation;
+				++active;
+			}
+			std::size_t index;
+			while (take(worker, index))
+				execute(worker, index);
+			// A batch ends only once every worker has left it, so none can take an input
+			// of the next batch while running the previous job
+			std::lock_guard<std::mutex> lock(mutex);
+			if (!--active)
+				done.notify_all();
+		}
+	}
+
+	void XMLBatchParser::execute(std::size_t worker, std::size_t index)
+	{
+		try
+		{
+			(*job)(worker, index);
+		}
+		catch (...)
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			if (!exception)
+				exception = std::current_exception();
+		}
+		pending.fetch_sub(1);
+	}
+
+	bool XMLBatchParser::take(std::size_t worker, std::size_t& index)
+	{
+		if (mode == Mode::InOrder)
+		{
+			index = next++;
+			return index < count;
+		}
+		if (mode == Mode::Submitted)
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			arrived.wait(lock, [&] { return !arrivals.empty() || closed; });
+			if (arrivals.empty())
+				return false;
+			index = arrivals.front();
+			arrivals.pop_front();
+			return true;
+		}
+		// Own run from the front, others' from the back
+		{
+			auto& queue = *queues[worker];
+			std::lock_guard<std::mutex> lock(queue.mutex);
+			if (!queue.jobs.empty())
+			{
+				index = queue.jobs.front();
+				queue.jobs.pop_front();
+				return true;
+			}
+		}
+		for (std::size_t i = 1; i < queues.size(); ++i)
+		{
+			auto& queue = *queues[(worker + i) % queues.size()];
+			std::lock_guard<std::mutex> lock(queue.mutex);
+			if (!queue.jobs.empty())
+			{
+				index = queue.jobs.back();
+				queue.jobs.pop_back();
+				return true;
+			}
+		}
+		return false;
+	}
+
+	void XMLBatchParser::start(std::size_t count_, const Job& job_, Mode mode_)
+	{
+		// A worker that woke late for the previous batch may still be leaving it
+		std::unique_lock<std::mutex> lock(mutex);
+		done.wait(lock, [&] { return !active; });
+		job = &job_;
+		exception = nullptr;
+		pending = count = count_;
+		next = 0;
+		mode = mode_;
+		if (!count)
+			return;
+		if (mode != Mode::Runs)
+		{
+			++generation;
+			wake.notify_all();
+			return;
+		}
+		auto n = queues.size();
+		for (std::size_t w = 0; w < n; ++w)
+		{
+			auto& queue = *queues[w];
+			std::lock_guard<std::mutex> queueLock(queue.mutex);
+			for (auto i = w * count / n, end = (w + 1) * count / n; i < end; ++i)
+				queue.jobs.push_back(i);
+		}
+		++generation;
+		wake.notify_all();
+	}
+
+	void XMLBatchParser::wait()
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		done.wait(lock, [&] { return pending == 0 && !active; });
+		job = nullptr;
+		if (exception)
+			std::rethrow_exception(std::exchange(exception, nullptr));
+	}
+
+	void XMLBatchParser::ordered(std::size_t total, const std::function<void(Slot&, std::size_t)>& parse, const std::function<void(const Result&)>& deliver)
+	{
+		auto window = threads.size() * 4;
+		while (orderedSlots.size() < window)
+			orderedSlots.emplace_back(new Slot());
+		for (auto& slot : orderedSlots)
+			slot->ready = false;
+		delivered = 0;
+
+		// Input i uses slot i % window, which is free once input i - window was delivered.
+		// Inputs are handed out in order, so the lowest undelivered one has been taken and,
+		// being within the window, never waits; the batch always makes progress.
+		Job job_ = [&](std::size_t /*worker*/, std::size_t index) {
+			auto& slot = *orderedSlots[index % window];
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				progress.wait(lock, [&] { return index < delivered + window; });
+			}
+			auto finish = [&] {
+				{
+					std::lock_guard<std::mutex> lock(mutex);
+					slot.ready = true;
+				}
+				progress.notify_all();
+			};
+			try
+			{
+				parse(slot, index);
+			}
+			catch (...)
+			{
+				slot.readable = false;
+				finish();
+				throw;
+			}
+			finish();
+		};
+		start(total, job_, Mode::InOrder);
+
+		std::exception_ptr error;
+		for (std::size_t index = 0; index < total; ++index)
+		{
+			auto& slot = *orderedSlots[index % window];
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				progress.wait(lock, [&] { return slot.ready; });
+			}
+			if (!error)
+			{
+				try
+				{
+					deliver(makeResult(slot, index));
+				}
+				catch (...)
+				{
+					error = std::current_exception();
+				}
+			}
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				slot.ready = false;
+				++delivered;
+			}
+			progress.notify_all();
+		}
+		wait();
+		if (error)
+			std::rethrow_exception(error);
+	}
+
+	void XMLBatchParser::submitted(std::size_t total, const Job& job_, const std::function<void(const Submit&)>& produce)
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			arrivals.clear();
+			submittedData.assign(total, nullptr);
+			submittedCount = 0;
+			closed = false;
+		}
+		start(total, job_, Mode::Submitted);
+
+		std::exception_ptr error;
+		try
+		{
+			produce([this](std::size_t index, char* data) { submit(index, data); });
+		}
+		catch (...)
+		{
+			error = std::current_exception();
+		}
+		// Workers leave once the arrivals run out; inputs never submitted are not waited for
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			closed = true;
+			pending.fetch_sub(total - submittedCount);
+		}
+		arrived.notify_all();
+		if (error)
+		{
+			try
+			{
+				wait();
+			}
+			catch (...)
+			{
+			}
+			std::rethrow_exception(error);
+		}
+		wait();
+	}
+
+	void XMLBatchParser::submit(std::size_t index, char* data)
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			submittedData[index] = data;
+			arrivals.push_back(index);
+			++submittedCount;
+		}
+		arrived.notify_one();
+	}
+
+	bool XMLBatchParser::readFile(const char* path, std::vector<char>& data)
+	{
+		// Positioned reads (pread) straight into the worker's buffer; a directory or any
+		// other file that cannot be read fails here rather than at the resize
+		try
+		{
+			File file(path, File::Mode::Read);
+			auto size = file.getSize();
+			if (size >= data.max_size())
+				return false;
+			data.resize(static_cast<std::size_t>(size) + 1);
+			data[static_cast<std::size_t>(size)] = 0;
+			return file.readAt(data.data(), static_cast<std::size_t>(size), 0) == size;
+		}
+		catch (const IOException&)
+		{
+			return false;
+		}
+	}
+
+}
+NS_END
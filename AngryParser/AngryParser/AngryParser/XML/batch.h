@@ -0,0 +1,219 @@
+﻿#ifndef _BATCH_HPP
+#define _BATCH_HPP
+
+#include <cstddef>
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../Core/compilerdetection.h"
+
+#include "document.h"
+
+NS_BEGINE
+inline namespace XML
+{
+
+// Parses batches of files or buffers on a persistent pool of worker threads. Each batch
+// is split into one run of inputs per worker; a worker that drains its own run steals
+// from the far end of another's; inputs that only become ready one by one, such as the
+// reads of XMLFileLoader, are queued with parseSubmitted instead. Every worker (or, in
+// ordered mode, every in-flight slot) owns a document and read buffer that are reset
+// rather than freed between inputs, so small inputs cost neither thread start-up nor
+// trips to the global heap.
+//
+// Only one batch runs at a time; parse calls block until their batch is done. An
+// exception thrown by a callback stops nothing, but is rethrown once the batch ends.
+class AngryParser_API XMLBatchParser
+{
+public:
+    struct Result
+    {
+        std::size_t index;     // position of the input in the batch
+        XMLDocument *document; // null if the file could not be read
+        XMLParseResult result;
+    };
+    // Passes input index to the workers: a NUL-terminated buffer, parsed in situ, or null
+    // for an input that could not be read
+    using Submit = std::function<void(std::size_t index, char *data)>;
+
+private:
+    enum class Mode
+    {
+        Runs,      // a run of inputs per worker, with stealing
+        InOrder,   // one at a time from next, in input order
+        Submitted, // from arrivals, as they are submitted
+    };
+    struct Slot
+    {
+        XMLDocument document;
+        std::vector<char> data;
+        XMLParseResult result;
+        bool readable;
+        bool ready;
+    };
+    struct Queue
+    {
+        std::mutex mutex;
+        std::deque<std::size_t> jobs;
+    };
+    using Job = std::function<void(std::size_t worker, std::size_t index)>;
+
+private:
+    std::vector<std::unique_ptr<Queue>> queues;
+    std::vector<std::unique_ptr<Slot>> workerSlots;
+    std::vector<std::thread> threads;
+
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable done;
+    const Job *job;
+    std::size_t generation;
+    std::atomic<std::size_t> pending;
+    std::atomic<std::size_t> next; // next input when inputs are handed out in order
+    std::size_t count;
+    Mode mode;
+    std::size_t active; // workers that joined the current batch and have not yet left it
+    std::exception_ptr exception;
+    bool stop;
+
+    // Ordered mode
+    std::vector<std::unique_ptr<Slot>> orderedSlots;
+    std::condition_variable progress;
+    std::size_t delivered;
+
+    // Submitted mode
+    std::deque<std::size_t> arrivals;
+    std::vector<char *> submittedData;
+    std::size_t submittedCount;
+    bool closed; // every input has been submitted, or produce gave up
+    std::condition_variable arrived;
+
+private:
+    void work(std::size_t worker);
+    bool take(std::size_t worker, std::size_t &index);
+    void start(std::size_t count_, const Job &job_, Mode mode_);
+    void wait();
+    void execute(std::size_t worker, std::size_t index);
+
+    void ordered(std::size_t total, const std::function<void(Slot &, std::size_t)> &parse, const std::function<void(const Result &)> &deliver);
+    void submitted(std::size_t total, const Job &job_, const std::function<void(const Submit &)> &produce);
+    void submit(std::size_t index, char *data);
+
+    static bool readFile(const char *path, std::vector<char> &data);
+
+    template <XMLParser::Flag F>
+    static void parseFile(Slot &slot, const std::string &path)
+    {
+        slot.readable = readFile(path.c_str(), slot.data);
+        slot.result = {XMLParseError::None, 0};
+        if (slot.readable)
+        {
+            slot.document.presize(slot.data.data(), slot.data.size() - 1);
+            slot.result = slot.document.tryParse<F>(slot.data.data());
+        }
+    }
+    template <XMLParser::Flag F>
+    static void parseBuffer(Slot &slot, char *data)
+    {
+        slot.readable = true;
+        slot.result = slot.document.tryParse<F>(data);
+    }
+    static Result makeResult(Slot &slot, std::size_t index) noexcept
+    {
+        return {index, slot.readable ? &slot.document : nullptr, slot.result};
+    }
+
+public:
+    // threads_ == 0 uses one worker per hardware thread
+    explicit XMLBatchParser(std::size_t threads_ = 0);
+    XMLBatchParser(const XMLBatchParser &src) = delete;
+    ~XMLBatchParser();
+
+    XMLBatchParser &operator=(const XMLBatchParser &src) = delete;
+
+    std::size_t getThreadCount() const noexcept { return threads.size(); }
+
+    // callback(const Result &) runs on a worker as each input finishes, in no particular
+    // order and concurrently with other callbacks. The document is reused once it returns.
+    template <XMLParser::Flag F = XMLParser::Flag::Default, typename C>
+    void parseFiles(const std::vector<std::string> &paths, C &&callback)
+    {
+        Job job = [&](std::size_t worker, std::size_t index) {
+            auto &slot = *workerSlots[worker];
+            parseFile<F>(slot, paths[index]);
+            callback(makeResult(slot, index));
+        };
+        start(paths.size(), job, Mode::Runs);
+        wait();
+    }
+    // Buffers are NUL-terminated and parsed in situ, as by XMLDocument::parse
+    template <XMLParser::Flag F = XMLParser::Flag::Default, typename C>
+    void parseBuffers(const std::vector<char *> &buffers, C &&callback)
+    {
+        Job job = [&](std::size_t worker, std::size_t index) {
+            auto &slot = *workerSlots[worker];
+            parseBuffer<F>(slot, buffers[index]);
+            callback(makeResult(slot, index));
+        };
+        start(buffers.size(), job, Mode::Runs);
+        wait();
+    }
+
+    // As above, but callback runs on the calling thread in input order. Workers run at
+    // most a fixed window of inputs ahead of the callback.
+    template <XMLParser::Flag F = XMLParser::Flag::Default, typename C>
+    void parseFilesOrdered(const std::vector<std::string> &paths, C &&callback)
+    {
+        ordered(paths.size(), [&](Slot &slot, std::size_t index) { parseFile<F>(slot, paths[index]); }, callback);
+    }
+    template <XMLParser::Flag F = XMLParser::Flag::Default, typename C>
+    void parseBuffersOrdered(const std::vector<char *> &buffers, C &&callback)
+    {
+        ordered(buffers.size(), [&](Slot &slot, std::size_t index) { parseBuffer<F>(slot, buffers[index]); }, callback);
+    }
+
+    // Batch of count inputs that become ready one by one, in any order. produce(submit)
+    // runs on the calling thread and calls submit(index, data) once for each input as it
+    // is ready; workers parse it meanwhile. release(index) runs on the worker after the
+    // callback for the input has returned, and the buffer is free from then on. If
+    // produce throws, the inputs submitted so far are finished and the exception rethrown.
+    template <XMLParser::Flag F = XMLParser::Flag::Default, typename P, typename C, typename R>
+    void parseSubmitted(std::size_t count_, P &&produce, C &&callback, R &&release)
+    {
+        Job job = [&](std::size_t worker, std::size_t index) {
+            auto &slot = *workerSlots[worker];
+            if (auto data = submittedData[index])
+                parseBuffer<F>(slot, data);
+            else
+            {
+                slot.readable = false;
+                slot.result = {XMLParseError::None, 0};
+            }
+            try
+            {
+                callback(makeResult(slot, index));
+            }
+            catch (...)
+            {
+                release(index);
+                throw;
+            }
+            release(index);
+        };
+        submitted(count_, job, produce);
+    }
+};
+
+} // namespace XML
+NS_END
+
+#endif
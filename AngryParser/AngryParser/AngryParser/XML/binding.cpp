@@ -0,0 +1,16 @@
+﻿#include "binding.h"
+
+NS_BEGINE
+inline namespace XML
+{
+	namespace Impl
+	{
+		void throwBindingError(StringView name, StringView value)
+		{
+			std::string message("Invalid value of ");
+			message.append(name.getData(), name.getLength()).append(": ").append(value.getData(), value.getLength());
+			throw XMLBindingException(StringView(message.data(), message.size()));
+		}
+	}
+}
+NS_END
@@ -0,0 +1,547 @@
+﻿#ifndef _BINDING_HPP
+#define _BINDING_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "../Core/compilerdetection.h"
+#include "../Core/exception.h"
+#include "../Core/hash.h"
+#include "../Core/number.h"
+#include "../Core/string.h"
+#include "handler.h"
+#include "parser.h"
+
+NS_BEGINE
+inline namespace XML
+{
+
+// Binds XML straight to plain structs, without a DOM. A struct is bound by a constexpr
+// function xmlBinding(const T *), found by argument-dependent lookup, that lists which
+// attributes, child elements and text of its element go to which members:
+//
+//     struct Server { std::string host; int port; };
+//     struct Config { int version; std::string name; std::vector<Server> servers; };
+//
+//     constexpr auto xmlBinding(const Server *)
+//     {
+//         return xmlFields(xmlAttribute("host", &Server::host), xmlText(&Server::port));
+//     }
+//     constexpr auto xmlBinding(const Config *)
+//     {
+//         return xmlFields(xmlAttribute("version", &Config::version), xmlElement("name", &Config::name),
+//                          xmlElement("server", &Config::servers));
+//     }
+//
+// XMLBindingHandler<Config> then fills a Config from the root element while it is being
+// parsed. Members may be numbers (read by parseNumber), bool, std::string, bound structs
+// (child elements only) and std::vector of these, which takes one child element per
+// entry. Unbound attributes and elements are skipped, subtrees included.
+//
+// Names are looked up in tables built at compile time for each struct, with a hash seed
+// chosen so that every name has a slot of its own: matching a name costs one hash of it
+// and one comparison.
+
+class XMLBindingException : public Exception
+{
+
+public:
+    XMLBindingException(const StringView &data) : Exception("XMLBindingException: ", data) {}
+};
+
+enum class XMLFieldKind
+{
+    Attribute,
+    Element,
+    Text,
+};
+
+template <typename T, typename M>
+struct XMLField
+{
+    XMLFieldKind kind;
+    const char *name;
+    std::size_t length;
+    M T::*member;
+};
+
+template <typename T, typename M, std::size_t N>
+constexpr XMLField<T, M> xmlAttribute(const char (&name)[N], M T::*member) noexcept
+{
+    return {XMLFieldKind::Attribute, name, N - 1, member};
+}
+
+template <typename T, typename M, std::size_t N>
+constexpr XMLField<T, M> xmlElement(const char (&name)[N], M T::*member) noexcept
+{
+    return {XMLFieldKind::Element, name, N - 1, member};
+}
+
+// The text of the element itself
+template <typename T, typename M>
+constexpr XMLField<T, M> xmlText(M T::*member) noexcept
+{
+    return {XMLFieldKind::Text, "", 0, member};
+}
+
+template <typename... F>
+constexpr std::tuple<F...> xmlFields(F... fields) noexcept
+{
+    return std::tuple<F...>(fields...);
+}
+
+namespace Impl
+{
+
+struct BindingOps;
+
+// The object an open element is bound to; ops is null while an unbound element is skipped
+struct BindingFrame
+{
+    void *object;
+    const BindingOps *ops;
+    StringView name;
+};
+
+// Type-erased operations of a bound type. attribute and text return false if the value
+// does not convert to the member.
+struct BindingOps
+{
+    BindingFrame (*element)(void *object, StringView name);
+    bool (*attribute)(void *object, StringView name, StringView value);
+    bool (*text)(void *object, StringView value);
+};
+
+[[noreturn]] AngryParser_API void throwBindingError(StringView name, StringView value);
+
+template <typename T, typename = void>
+struct IsBound : std::false_type
+{
+};
+template <typename T>
+struct IsBound<T, decltype(void(xmlBinding(static_cast<const T *>(nullptr))))> : std::true_type
+{
+};
+
+constexpr std::uint64_t hashName(const char *name, std::size_t length) noexcept
+{
+    std::uint64_t h = 0xCBF29CE484222325ULL;
+    for (std::size_t i = 0; i < length; ++i)
+        h = (h ^ static_cast<unsigned char>(name[i])) * 0x100000001B3ULL;
+    return h;
+}
+
+constexpr std::size_t getNameSlot(std::uint64_t hash, std::uint64_t seed, std::size_t capacity) noexcept
+{
+    return static_cast<std::size_t>(((hash ^ seed * Core::Impl::HashPrime2) * Core::Impl::HashPrime1) >> 40) & (capacity - 1);
+}
+
+// At least twice the number of names, so that lookups of unknown names end at an empty slot
+constexpr std::size_t getNameTableCapacity(std::size_t count) noexcept
+{
+    std::size_t capacity = 4;
+    while (capacity < count * 2)
+        capacity <<= 1;
+    return capacity;
+}
+
+struct FieldName
+{
+    XMLFieldKind kind;
+    const char *name;
+    std::size_t length;
+    std::uint64_t hash;
+};
+
+template <std::size_t N>
+struct FieldNames
+{
+    FieldName names[N ? N : 1];
+};
+
+template <std::size_t Capacity>
+struct NameTable
+{
+    std::uint64_t seed;
+    std::uint16_t slots[Capacity]; // index of the field plus one, 0 if empty
+};
+
+template <typename Fields, std::size_t... I>
+constexpr FieldNames<sizeof...(I)> getFieldNames(const Fields &fields, std::index_sequence<I...>) noexcept
+{
+    return {{{std::get<I>(fields).kind, std::get<I>(fields).name, std::get<I>(fields).length,
+              hashName(std::get<I>(fields).name, std::get<I>(fields).length)}...}};
+}
+
+template <std::size_t N>
+constexpr bool hasDuplicateNames(const FieldNames<N> &fields) noexcept
+{
+    for (std::size_t i = 0; i < N; ++i)
+    {
+        for (std::size_t j = 0; j < i; ++j)
+        {
+            auto &a = fields.names[i];
+            auto &b = fields.names[j];
+            if (a.kind == b.kind && a.length == b.length)
+            {
+                std::size_t k = 0;
+                while (k < a.length && a.name[k] == b.name[k])
+                    ++k;
+                if (k == a.length)
+                    return true;
+            }
+        }
+    }
+    return false;
+}
+
+template <std::size_t N>
+constexpr std::size_t findTextField(const FieldNames<N> &fields) noexcept
+{
+    for (std::size_t i = 0; i < N; ++i)
+    {
+        if (fields.names[i].kind == XMLFieldKind::Text)
+            return i;
+    }
+    return N;
+}
+
+// Try a few seeds and keep the one with the fewest names out of their own slot, which is
+// almost always none. The others are found by linear probing.
+template <std::size_t N, std::size_t Capacity>
+constexpr NameTable<Capacity> makeNameTable(const FieldNames<N> &fields, XMLFieldKind kind) noexcept
+{
+    NameTable<Capacity> best{};
+    std::size_t fewest = N + 1;
+    for (std::uint64_t seed = 0; seed < 64 && fewest; ++seed)
+    {
+        NameTable<Capacity> table{};
+        table.seed = seed;
+        std::size_t displaced = 0;
+        for (std::size_t i = 0; i < N; ++i)
+        {
+            if (fields.names[i].kind != kind)
+                continue;
+            auto slot = getNameSlot(fields.names[i].hash, seed, Capacity);
+            if (table.slots[slot])
+                ++displaced;
+            while (table.slots[slot])
+                slot = (slot + 1) & (Capacity - 1);
+            table.slots[slot] = static_cast<std::uint16_t>(i + 1);
+        }
+        if (displaced < fewest)
+        {
+            best = table;
+            fewest = displaced;
+        }
+    }
+    return best;
+}
+
+// Index of the field called name, or N if there is none
+template <std::size_t N, std::size_t Capacity>
+std::size_t findName(const NameTable<Capacity> &table, const FieldNames<N> &fields, StringView name) noexcept
+{
+    auto hash = hashName(name.getData(), name.getLength());
+    for (auto i = getNameSlot(hash, table.seed, Capacity);; i = (i + 1) & (Capacity - 1))
+    {
+        std::size_t slot = table.slots[i];
+        if (!slot)
+            return N;
+        auto &field = fields.names[slot - 1];
+        if (field.hash == hash && field.length == name.getLength() && !std::memcmp(field.name, name.getData(), field.length))
+            return slot - 1;
+    }
+}
+
+inline StringView trimSpace(StringView value) noexcept
+{
+    auto isSpace = [](char c) { return c == ' ' || c == '\t' || c == '\n' || c == '\r'; };
+    auto begin = value.begin(), end = value.end();
+    while (begin != end && isSpace(*begin))
+        ++begin;
+    while (end != begin && isSpace(end[-1]))
+        --end;
+    return StringView(begin, end);
+}
+
+template <typename M>
+typename std::enable_if<std::is_arithmetic<M>::value, bool>::type setValue(M &member, StringView value) noexcept
+{
+    return parseNumber(value, member);
+}
+
+// xs:boolean: true, false, 1 or 0
+inline bool setValue(bool &member, StringView value) noexcept
+{
+    value = trimSpace(value);
+    if (value == "true" || value == "1")
+        member = true;
+    else if (value == "false" || value == "0")
+        member = false;
+    else
+        return false;
+    return true;
+}
+
+inline bool setValue(std::string &member, StringView value)
+{
+    member.assign(value.getData(), value.getLength());
+    return true;
+}
+
+// Text may arrive in several pieces, split by comments or CDATA sections
+template <typename M>
+bool appendValue(M &member, StringView value)
+{
+    return setValue(member, value);
+}
+
+inline bool appendValue(std::string &member, StringView value)
+{
+    member.append(value.getData(), value.getLength());
+    return true;
+}
+
+template <typename M>
+void clearValue(M & /*member*/) noexcept
+{
+}
+
+inline void clearValue(std::string &member) noexcept
+{
+    member.clear();
+}
+
+template <typename M>
+BindingFrame bindChild(M &member);
+template <typename M, typename A>
+BindingFrame bindChild(std::vector<M, A> &member);
+
+template <typename T>
+struct Binding;
+
+// A member bound to the text of a child element
+template <typename M>
+struct ScalarBinding
+{
+    static BindingFrame element(void * /*object*/, StringView /*name*/) noexcept { return {nullptr, nullptr, StringView()}; }
+    static bool attribute(void * /*object*/, StringView /*name*/, StringView /*value*/) noexcept { return true; }
+    static bool text(void *object, StringView value) { return appendValue(*static_cast<M *>(object), value); }
+
+    static constexpr BindingOps ops = {&element, &attribute, &text};
+};
+template <typename M>
+constexpr BindingOps ScalarBinding<M>::ops;
+
+template <typename M>
+BindingFrame bindChild(M &member, std::true_type /*bound*/) noexcept
+{
+    return {&member, &Binding<M>::ops, StringView()};
+}
+
+template <typename M>
+BindingFrame bindChild(M &member, std::false_type /*bound*/) noexcept
+{
+    clearValue(member);
+    return {&member, &ScalarBinding<M>::ops, StringView()};
+}
+
+template <typename M>
+BindingFrame bindChild(M &member)
+{
+    return bindChild(member, IsBound<M>());
+}
+
+template <typename M, typename A>
+BindingFrame bindChild(std::vector<M, A> &member)
+{
+    member.emplace_back();
+    return bindChild(member.back());
+}
+
+using ElementOp = BindingFrame (*)(void *object);
+using ValueOp = bool (*)(void *object, StringView value);
+
+template <typename T, std::size_t I>
+struct FieldBinding
+{
+    static auto &member(void *object) noexcept { return static_cast<T *>(object)->*std::get<I>(Binding<T>::fields).member; }
+
+    static BindingFrame element(void *object) { return bindChild(member(object)); }
+    static bool attribute(void *object, StringView value) { return setValue(member(object), value); }
+    static bool text(void *object, StringView value) { return appendValue(member(object), value); }
+};
+
+// Only the operations of the field's kind are instantiated, so that an attribute need not
+// be something a child element could be bound to and the other way round
+template <typename T, std::size_t I>
+constexpr ElementOp getElementOp(std::true_type) noexcept { return &FieldBinding<T, I>::element; }
+template <typename T, std::size_t I>
+constexpr ElementOp getElementOp(std::false_type) noexcept { return nullptr; }
+template <typename T, std::size_t I>
+constexpr ValueOp getAttributeOp(std::true_type) noexcept { return &FieldBinding<T, I>::attribute; }
+template <typename T, std::size_t I>
+constexpr ValueOp getAttributeOp(std::false_type) noexcept { return nullptr; }
+template <typename T, std::size_t I>
+constexpr ValueOp getTextOp(std::true_type) noexcept { return &FieldBinding<T, I>::text; }
+template <typename T, std::size_t I>
+constexpr ValueOp getTextOp(std::false_type) noexcept { return nullptr; }
+
+template <typename T, std::size_t I, XMLFieldKind K>
+using IsFieldKind = std::integral_constant<bool, Binding<T>::names.names[I].kind == K>;
+
+template <typename T, typename S>
+struct FieldOps;
+template <typename T, std::size_t... I>
+struct FieldOps<T, std::index_sequence<I...>>
+{
+    static constexpr ElementOp element[sizeof...(I) + 1] = {getElementOp<T, I>(IsFieldKind<T, I, XMLFieldKind::Element>())..., nullptr};
+    static constexpr ValueOp attribute[sizeof...(I) + 1] = {getAttributeOp<T, I>(IsFieldKind<T, I, XMLFieldKind::Attribute>())..., nullptr};
+    static constexpr ValueOp text[sizeof...(I) + 1] = {getTextOp<T, I>(IsFieldKind<T, I, XMLFieldKind::Text>())..., nullptr};
+};
+template <typename T, std::size_t... I>
+constexpr ElementOp FieldOps<T, std::index_sequence<I...>>::element[sizeof...(I) + 1];
+template <typename T, std::size_t... I>
+constexpr ValueOp FieldOps<T, std::index_sequence<I...>>::attribute[sizeof...(I) + 1];
+template <typename T, std::size_t... I>
+constexpr ValueOp FieldOps<T, std::index_sequence<I...>>::text[sizeof...(I) + 1];
+
+template <typename T>
+struct Binding
+{
+    using Fields = decltype(xmlBinding(static_cast<const T *>(nullptr)));
+    using Ops = FieldOps<T, std::make_index_sequence<std::tuple_size<Fields>::value>>;
+
+    static constexpr std::size_t Count = std::tuple_size<Fields>::value;
+    static constexpr std::size_t Capacity = getNameTableCapacity(Count);
+
+    static constexpr Fields fields = xmlBinding(static_cast<const T *>(nullptr));
+    static constexpr FieldNames<Count> names = getFieldNames(fields, std::make_index_sequence<Count>());
+    static constexpr NameTable<Capacity> elements = makeNameTable<Count, Capacity>(names, XMLFieldKind::Element);
+    static constexpr NameTable<Capacity> attributes = makeNameTable<Count, Capacity>(names, XMLFieldKind::Attribute);
+    static constexpr std::size_t textField = findTextField(names);
+
+    static_assert(Count < 0xFFFF, "Too many fields in an XML binding");
+    static_assert(!hasDuplicateNames(names), "An XML binding names an attribute or element twice");
+
+    static BindingFrame element(void *object, StringView name)
+    {
+        auto i = findName(elements, names, name);
+        return i < Count ? Ops::element[i](object) : BindingFrame{nullptr, nullptr, StringView()};
+    }
+    static bool attribute(void *object, StringView name, StringView value)
+    {
+        auto i = findName(attributes, names, name);
+        return i < Count ? Ops::attribute[i](object, value) : true;
+    }
+    static bool text(void *object, StringView value)
+    {
+        return textField < Count ? Ops::text[textField](object, value) : true;
+    }
+
+    static constexpr BindingOps ops = {&element, &attribute, &text};
+};
+template <typename T>
+constexpr typename Binding<T>::Fields Binding<T>::fields;
+template <typename T>
+constexpr FieldNames<Binding<T>::Count> Binding<T>::names;
+template <typename T>
+constexpr NameTable<Binding<T>::Capacity> Binding<T>::elements;
+template <typename T>
+constexpr NameTable<Binding<T>::Capacity> Binding<T>::attributes;
+template <typename T>
+constexpr BindingOps Binding<T>::ops;
+
+} // namespace Impl
+
+// Handler that fills object from the root element as the document is parsed, with or
+// without Flag::Namespaces (names are then matched by their local part). A value that
+// does not convert to its member throws XMLBindingException, so use it with parse rather
+// than tryParse.
+template <typename T>
+class XMLBindingHandler : public XMLHandlerBase
+{
+    static_assert(Impl::IsBound<T>::value, "T needs an xmlBinding(const T *) function");
+
+private:
+    T &object;
+    std::vector<Impl::BindingFrame> frames;
+
+private:
+    void push(StringView name)
+    {
+        Impl::BindingFrame frame{nullptr, nullptr, StringView()};
+        if (frames.empty())
+            frame = {&object, &Impl::Binding<T>::ops, StringView()};
+        else if (frames.back().ops)
+            frame = frames.back().ops->element(frames.back().object, name);
+        frame.name = name;
+        frames.push_back(frame);
+    }
+    void setAttribute(StringView name, StringView value)
+    {
+        auto &frame = frames.back();
+        if (frame.ops && !frame.ops->attribute(frame.object, name, value))
+            Impl::throwBindingError(name, value);
+    }
+    void setText(StringView value)
+    {
+        if (frames.empty())
+            return;
+        auto &frame = frames.back();
+        if (frame.ops && !frame.ops->text(frame.object, value))
+            Impl::throwBindingError(frame.name, value);
+    }
+
+public:
+    explicit XMLBindingHandler(T &object_) : object(object_), frames() { frames.reserve(16); }
+
+    void startElement(StringView name) { push(name); }
+    void endElement(StringView /*name*/) { frames.pop_back(); }
+    // An empty element ends here, without endElement
+    void endAttributes(bool empty)
+    {
+        if (empty)
+            frames.pop_back();
+    }
+    void attribute(StringView name, StringView value) { setAttribute(name, value); }
+    void text(StringView value) { setText(value); }
+    void cdata(StringView value) { setText(value); }
+
+    void startElementNS(const XMLQualifiedName &name) { push(name.localName); }
+    void endElementNS(const XMLQualifiedName & /*name*/) { frames.pop_back(); }
+    void attributeNS(const XMLQualifiedName &name, StringView value)
+    {
+        if (name.uri != XMLNamespace::XMLNS)
+            setAttribute(name.localName, value);
+    }
+};
+
+// Parse data into object through an XMLBindingHandler
+template <XMLParser::Flag F = XMLParser::Flag::Default, typename T>
+void parseInto(char *data, T &object)
+{
+    XMLParser parser;
+    XMLBindingHandler<T> handler(object);
+    parser.parse<F>(data, handler);
+}
+template <XMLParser::Flag F = XMLParser::Flag::Default, typename T>
+void parseInto(const char *data, T &object)
+{
+    XMLParser parser;
+    XMLBindingHandler<T> handler(object);
+    parser.parse<F>(data, handler);
+}
+
+} // namespace XML
+NS_END
+
+#endif
@@ -0,0 +1,139 @@
+﻿#include "cache.h"
+
+#include <cstring>
+#include <fstream>
+
+#include <sys/stat.h>
+#include <sys/types.h>
+
+NS_BEGINE
+inline namespace XML
+{
+	XMLDocumentCache::XMLDocumentCache(std::size_t maxEntries_, std::size_t maxBytes_) : mutex(), maxEntries(maxEntries_), maxBytes(maxBytes_), lru(), entries(), files(), statistics()
+	{
+	}
+
+	bool XMLDocumentCache::matches(const Entry& entry, const char* data) noexcept
+	{
+		return entry.data.size() == entry.key.length + 1 && (!entry.key.length || !std::memcmp(entry.data.data(), data, entry.key.length));
+	}
+
+	std::shared_ptr<const XMLDocument> XMLDocumentCache::find(const Key& key, const char* data)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		auto it = entries.find(key);
+		if (it == entries.end() || !matches(**it->second, data))
+		{
+			++statistics.misses;
+			return nullptr;
+		}
+		lru.splice(lru.begin(), lru, it->second);
+		++statistics.hits;
+		auto& entry = *it->second;
+		return std::shared_ptr<const XMLDocument>(entry, &entry->document);
+	}
+
+	std::shared_ptr<const XMLDocument> XMLDocumentCache::insert(const std::shared_ptr<Entry>& entry, const std::string* path, std::int64_t mtime, std::uint64_t size)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		auto it = entries.find(entry->key);
+		if (it == entries.end())
+		{
+			lru.push_front(entry);
+			it = entries.emplace(entry->key, lru.begin()).first;
+			statistics.bytes += entry->bytes;
+			statistics.entries = entries.size();
+		}
+		auto& p = *it->second;
+		// Same key, other bytes: keep the cached entry and hand out this one uncached
+		if (p != entry && !matches(*p, entry->data.data()))
+			return std::shared_ptr<const XMLDocument>(entry, &entry->document);
+		if (path)
+		{
+			if (std::find(p->paths.begin(), p->paths.end(), *path) == p->paths.end())
+				p->paths.push_back(*path);
+			files[*path] = { p->key, mtime, size };
+		}
+		std::shared_ptr<const XMLDocument> document(p, &p->document);
+		evict();
+		return document;
+	}
+
+	void XMLDocumentCache::evict()
+	{
+		// Always keep the most recently used entry, even if it alone exceeds the budget
+		while (lru.size() > 1 && (lru.size() > maxEntries || statistics.bytes > maxBytes))
+		{
+			auto& entry = lru.back();
+			for (auto& path : entry->paths)
+			{
+				auto file = files.find(path);
+				if (file != files.end() && file->second.key == entry->key)
+					files.erase(file);
+			}
+			statistics.bytes -= entry->bytes;
+			++statistics.evictions;
+			entries.erase(entry->key);
+			lru.pop_back();
+		}
+		statistics.entries = entries.size();
+	}
+
+	bool XMLDocumentCache::stat(const char* path, std::int64_t& mtime, std::uint64_t& size)
+	{
+#if defined(_WIN32)
+		struct _stat64 st;
+		if (::_stat64(path, &st))
+			return false;
+#else
+		struct ::stat st;
+		if (::stat(path, &st))
+			return false;
+#endif
+		mtime = static_cast<std::int64_t>(st.st_mtime);
+		size = static_cast<std::uint64_t>(st.st_size);
+		return true;
+	}
+
+	std::vector<char> XMLDocumentCache::readFile(const char* path)
+	{
+		std::ifstream is(path, std::ios::binary);
+		if (!is) throw IOException("Cannot read file");
+		is.seekg(0, std::ios::end);
+		auto end = is.tellg();
+		if (end < 0) throw IOException("Cannot read file");
+		std::size_t size = static_cast<std::size_t>(end);
+		is.seekg(0);
+		std::vector<char> data(size);
+		is.read(data.data(), size);
+		if (static_cast<std::size_t>(is.gcount()) != size)
+			throw IOException("Cannot read file");
+		return data;
+	}
+
+	void XMLDocumentCache::clear()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		entries.clear();
+		files.clear();
+		lru.clear();
+		statistics.bytes = 0;
+		statistics.entries = 0;
+	}
+
+	void XMLDocumentCache::setCapacity(std::size_t maxEntries_, std::size_t maxBytes_)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		maxEntries = maxEntries_;
+		maxBytes = maxBytes_;
+		evict();
+	}
+
+	XMLDocumentCache::Statistics XMLDocumentCache::getStatistics() const
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		return statistics;
+	}
+
+}
+NS_END
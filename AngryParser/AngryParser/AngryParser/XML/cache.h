@@ -0,0 +1,191 @@
+﻿#ifndef _CACHE_HPP
+#define _CACHE_HPP
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+
+#include <algorithm>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "../Core/compilerdetection.h"
+
+#include "../Core/hash.h"
+#include "document.h"
+
+NS_BEGINE
+inline namespace XML
+{
+
+// Parse cache in front of XMLDocument::parse.
+// Documents are keyed by a 64-bit hash of their content (plus length and parse flags),
+// and files additionally by (path, mtime, size), so a repeated parse of identical input
+// becomes a lookup. Hits share one immutable document; entries are evicted in LRU order
+// once either the entry or the byte budget is exceeded. Evicted documents stay alive
+// until the last shared_ptr handed out for them is released.
+class AngryParser_API XMLDocumentCache
+{
+public:
+    struct Statistics
+    {
+        std::uint64_t hits;
+        std::uint64_t misses;
+        std::uint64_t evictions;
+        std::size_t entries;
+        std::size_t bytes;
+    };
+
+private:
+    struct Key
+    {
+        std::uint64_t hash;
+        std::size_t length;
+        std::uint32_t flags;
+
+        friend bool operator==(const Key &a, const Key &b) noexcept { return a.hash == b.hash && a.length == b.length && a.flags == b.flags; }
+    };
+    struct KeyHash
+    {
+        std::size_t operator()(const Key &key) const noexcept { return static_cast<std::size_t>(key.hash); }
+    };
+
+    struct Entry
+    {
+        Key key;
+        std::vector<char> data;
+        XMLDocument document;
+        std::size_t bytes;
+        std::vector<std::string> paths;
+    };
+    using EntryList = std::list<std::shared_ptr<Entry>>;
+
+    struct FileKey
+    {
+        Key key;
+        std::int64_t mtime;
+        std::uint64_t size;
+    };
+
+private:
+    mutable std::mutex mutex;
+    std::size_t maxEntries;
+    std::size_t maxBytes;
+    EntryList lru;
+    std::unordered_map<Key, EntryList::iterator, KeyHash> entries;
+    std::unordered_map<std::string, FileKey> files;
+    Statistics statistics;
+
+private:
+    // The hash is not keyed, so a hit is confirmed against the cached bytes; a collision
+    // is a miss
+    std::shared_ptr<const XMLDocument> find(const Key &key, const char *data);
+    std::shared_ptr<const XMLDocument> insert(const std::shared_ptr<Entry> &entry, const std::string *path, std::int64_t mtime, std::uint64_t size);
+    void evict();
+
+    static bool matches(const Entry &entry, const char *data) noexcept;
+    static bool stat(const char *path, std::int64_t &mtime, std::uint64_t &size);
+    static std::vector<char> readFile(const char *path);
+
+    template <XMLParser::Flag F>
+    static Key makeKey(const char *data, std::size_t length) noexcept
+    {
+        return {hashBytes(data, length, static_cast<std::uint32_t>(F)), length, static_cast<std::uint32_t>(F)};
+    }
+
+    template <XMLParser::Flag F>
+    std::shared_ptr<const XMLDocument> build(const Key &key, std::vector<char> &&data, const std::string *path, std::int64_t mtime, std::uint64_t size)
+    {
+        // Parse outside the lock; a concurrent miss on the same key parses twice and the
+        // first one to insert wins.
+        auto entry = std::make_shared<Entry>();
+        entry->key = key;
+        entry->data = std::move(data);
+        entry->data.push_back(0);
+        entry->document.presize(entry->data.data(), key.length);
+        // Read-only parse, so that the bytes stay as they came for matches
+        entry->document.template parse<F>(static_cast<const char *>(entry->data.data()));
+        entry->bytes = sizeof(Entry) + entry->data.capacity() + entry->document.getArenaReserved();
+        return insert(entry, path, mtime, size);
+    }
+
+public:
+    XMLDocumentCache(std::size_t maxEntries_ = 1024, std::size_t maxBytes_ = std::size_t(256) << 20);
+    XMLDocumentCache(const XMLDocumentCache &src) = delete;
+    ~XMLDocumentCache() = default;
+
+    XMLDocumentCache &operator=(const XMLDocumentCache &src) = delete;
+
+    // Return the document for data[0, length), parsing a private copy on a miss.
+    template <XMLParser::Flag F = XMLParser::Flag::Default>
+    std::shared_ptr<const XMLDocument> parse(const char *data, std::size_t length)
+    {
+        assert(data);
+
+        auto key = makeKey<F>(data, length);
+        if (auto document = find(key, data))
+            return document;
+        return build<F>(key, std::vector<char>(data, data + length), nullptr, 0, 0);
+    }
+
+    // Return the document for the file at path. An unchanged (mtime, size) skips reading
+    // the file; changed files are re-read and still share entries by content.
+    template <XMLParser::Flag F = XMLParser::Flag::Default>
+    std::shared_ptr<const XMLDocument> load(const char *path)
+    {
+        assert(path);
+
+        std::int64_t mtime;
+        std::uint64_t size;
+        if (!stat(path, mtime, size))
+            throw IOException("Cannot stat file");
+        std::string name(path);
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            auto it = files.find(name);
+            if (it != files.end() && it->second.mtime == mtime && it->second.size == size && it->second.key.flags == static_cast<std::uint32_t>(F))
+            {
+                auto entry = entries.find(it->second.key);
+                if (entry != entries.end())
+                {
+                    lru.splice(lru.begin(), lru, entry->second);
+                    ++statistics.hits;
+                    auto &p = *entry->second;
+                    return std::shared_ptr<const XMLDocument>(p, &p->document);
+                }
+            }
+        }
+
+        auto data = readFile(path);
+        auto key = makeKey<F>(data.data(), data.size());
+        if (auto document = find(key, data.data()))
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            auto entry = entries.find(key);
+            if (entry != entries.end())
+            {
+                auto &paths = (*entry->second)->paths;
+                if (std::find(paths.begin(), paths.end(), name) == paths.end())
+                    paths.push_back(name);
+            }
+            files[name] = {key, mtime, size};
+            return document;
+        }
+        return build<F>(key, std::move(data), &name, mtime, size);
+    }
+
+    void clear();
+
+    void setCapacity(std::size_t maxEntries_, std::size_t maxBytes_);
+
+    Statistics getStatistics() const;
+};
+
+} // namespace XML
+NS_END
+
+#endif
@@ -0,0 +1,262 @@
+﻿#include "compressed.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+
+#include "../Core/exception.h"
+
+#if defined(ANGRYPARSER_WITH_ZLIB)
+#include <zlib.h>
+#endif
+#if defined(ANGRYPARSER_WITH_ZSTD)
+#include <zstd.h>
+#endif
+
+NS_BEGINE
+inline namespace XML
+{
+	namespace
+	{
+		// Decodes from [in, inEnd) to [out, outEnd), advancing both. Called with no input
+		// at the end of the file until it makes no more progress.
+		class Decoder
+		{
+		public:
+			virtual ~Decoder() = default;
+
+			virtual void decode(const char*& in, const char* inEnd, char*& out, char* outEnd) = 0;
+			// Check that the input did not stop in the middle of a stream
+			virtual void finish() {}
+		};
+
+		class PlainDecoder : public Decoder
+		{
+		public:
+			void decode(const char*& in, const char* inEnd, char*& out, char* outEnd) override
+			{
+				auto n = std::min<std::size_t>(inEnd - in, outEnd - out);
+				std::memcpy(out, in, n);
+				in += n;
+				out += n;
+			}
+		};
+
+#if defined(ANGRYPARSER_WITH_ZLIB)
+		class GzipDecoder : public Decoder
+		{
+		public:
+			GzipDecoder() : stream(), ended(true)
+			{
+				if (inflateInit2(&stream, 15 + 16) != Z_OK)
+					throw IOException("Cannot initialize zlib");
+			}
+			~GzipDecoder() override { inflateEnd(&stream); }
+
+			void decode(const char*& in, const char* inEnd, char*& out, char* outEnd) override
+			{
+				// A new member may follow the end of the previous one
+				if (ended && in != inEnd)
+				{
+					inflateReset(&stream);
+					ended = false;
+				}
+				stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(in));
+				stream.avail_in = static_cast<uInt>(std::min<std::size_t>(inEnd - in, UINT32_MAX));
+				stream.next_out = reinterpret_cast<Bytef*>(out);
+				stream.avail_out = static_cast<uInt>(std::min<std::size_t>(outEnd - out, UINT32_MAX));
+				auto ret = ended ? Z_BUF_ERROR : inflate(&stream, Z_NO_FLUSH);
+				in = reinterpret_cast<const char*>(stream.next_in);
+				out = reinterpret_cast<char*>(stream.next_out);
+				if (ret == Z_STREAM_END)
+					ended = true;
+				else if (ret != Z_OK && ret != Z_BUF_ERROR)
+					throw IOException("Corrupt gzip data");
+			}
+			void finish() override
+			{
+				if (!ended)
+					throw IOException("Truncated gzip data");
+			}
+
+		private:
+			z_stream stream;
+			bool ended;
+		};
+#endif
+
+#if defined(ANGRYPARSER_WITH_ZSTD)
+		class ZstdDecoder : public Decoder
+		{
+		public:
+			ZstdDecoder() : stream(ZSTD_createDStream()), ended(true)
+			{
+				if (!stream)
+					throw IOException("Cannot initialize zstd");
+			}
+			~ZstdDecoder() override { ZSTD_freeDStream(stream); }
+
+			void decode(const char*& in, const char* inEnd, char*& out, char* outEnd) override
+			{
+				ZSTD_inBuffer input{in, static_cast<std::size_t>(inEnd - in), 0};
+				ZSTD_outBuffer output{out, static_cast<std::size_t>(outEnd - out), 0};
+				auto ret = ZSTD_decompressStream(stream, &output, &input);
+				if (ZSTD_isError(ret))
+					throw IOException("Corrupt zstd data");
+				in += input.pos;
+				out += output.pos;
+				// Frames follow each other without a reset; 0 means one just ended
+				if (input.pos || output.pos)
+					ended = ret == 0;
+			}
+			void finish() override
+			{
+				if (!ended)
+					throw IOException("Truncated zstd data");
+			}
+
+		private:
+			ZSTD_DStream* stream;
+			bool ended;
+		};
+#endif
+
+		std::unique_ptr<Decoder> makeDecoder(XMLDecompressor::Format format)
+		{
+			switch (format)
+			{
+			case XMLDecompressor::Format::Gzip:
+#if defined(ANGRYPARSER_WITH_ZLIB)
+				return std::unique_ptr<Decoder>(new GzipDecoder());
+#else
+				throw IOException("gzip input needs ANGRYPARSER_WITH_ZLIB");
+#endif
+			case XMLDecompressor::Format::Zstd:
+#if defined(ANGRYPARSER_WITH_ZSTD)
+				return std::unique_ptr<Decoder>(new ZstdDecoder());
+#else
+				throw IOException("zstd input needs ANGRYPARSER_WITH_ZSTD");
+#endif
+			default:
+				return std::unique_ptr<Decoder>(new PlainDecoder());
+			}
+		}
+	}
+
+	XMLDecompressor::XMLDecompressor(const char* path, std::size_t bufferSize, std::size_t bufferCount) : file(path, File::Mode::Read), format(Format::Plain), buffers(std::max<std::size_t>(bufferCount, 2)), readIndex(), writeIndex(), held(), finished(), stopped(), error(), mutex(), filled(), emptied(), thread()
+	{
+		unsigned char magic[4] = {};
+		auto n = file.readAt(magic, sizeof(magic), 0);
+		if (n >= 2 && magic[0] == 0x1F && magic[1] == 0x8B)
+			format = Format::Gzip;
+		else if (n == 4 && magic[0] == 0x28 && magic[1] == 0xB5 && magic[2] == 0x2F && magic[3] == 0xFD)
+			format = Format::Zstd;
+		for (auto& buffer : buffers)
+		{
+			buffer.data.resize(std::max<std::size_t>(bufferSize, 1));
+			buffer.size = 0;
+			buffer.full = false;
+		}
+		thread = std::thread(&XMLDecompressor::run, this);
+	}
+
+	XMLDecompressor::~XMLDecompressor()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stopped = true;
+		}
+		emptied.notify_one();
+		thread.join();
+	}
+
+	void XMLDecompressor::run()
+	{
+		try
+		{
+			auto decoder = makeDecoder(format);
+			std::vector<char> input(std::min<std::size_t>(buffers[0].data.size(), std::size_t(1) << 18));
+			std::uint64_t offset = 0;
+			std::size_t position = 0, available = 0;
+			// The decoder may still hold output, say a whole block, when the input ends,
+			// and more of it than fits in one buffer; it is done only once a call with no
+			// input left makes no progress
+			bool eof = false, drained = false;
+			while (!drained)
+			{
+				auto& buffer = buffers[writeIndex];
+				{
+					std::unique_lock<std::mutex> lock(mutex);
+					emptied.wait(lock, [&] { return !buffer.full || stopped; });
+					if (stopped)
+						return;
+				}
+				auto begin = buffer.data.data();
+				auto out = begin, outEnd = begin + buffer.data.size();
+				while (out != outEnd)
+				{
+					if (position == available && !eof)
+					{
+						available = file.readAt(input.data(), input.size(), offset);
+						offset += available;
+						position = 0;
+						eof = !available;
+					}
+					const char* in = input.data() + position;
+					auto before = out;
+					decoder->decode(in, input.data() + available, out, outEnd);
+					position = in - input.data();
+					if (eof && out == before)
+					{
+						drained = true;
+						break;
+					}
+				}
+				if (out != begin)
+				{
+					std::lock_guard<std::mutex> lock(mutex);
+					buffer.size = out - begin;
+					buffer.full = true;
+					writeIndex = (writeIndex + 1) % buffers.size();
+				}
+				filled.notify_one();
+			}
+			decoder->finish();
+		}
+		catch (...)
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			error = std::current_exception();
+		}
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			finished = true;
+		}
+		filled.notify_one();
+	}
+
+	StringView XMLDecompressor::read()
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		if (held)
+		{
+			buffers[readIndex].full = false;
+			readIndex = (readIndex + 1) % buffers.size();
+			held = false;
+			emptied.notify_one();
+		}
+		auto& buffer = buffers[readIndex];
+		filled.wait(lock, [&] { return buffer.full || finished; });
+		if (buffer.full)
+		{
+			held = true;
+			return StringView(buffer.data.data(), buffer.size);
+		}
+		if (error)
+			std::rethrow_exception(error);
+		return StringView();
+	}
+
+}
+NS_END
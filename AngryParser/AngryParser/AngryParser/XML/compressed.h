@@ -0,0 +1,135 @@
+﻿#ifndef _COMPRESSED_HPP
+#define _COMPRESSED_HPP
+
+#include <cstddef>
+
+#include <condition_variable>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "../Core/compilerdetection.h"
+#include "../Core/file.h"
+#include "../Core/string.h"
+#include "stream.h"
+
+NS_BEGINE
+inline namespace XML
+{
+
+// Decompresses a file on a thread of its own into a ring of buffers, which read() hands
+// out as they fill. The format is told by the magic bytes: gzip (possibly several
+// concatenated members) needs ANGRYPARSER_WITH_ZLIB and zstd needs ANGRYPARSER_WITH_ZSTD,
+// with zlib or libzstd linked; anything else is passed through as it is. Without them,
+// which is how the Visual Studio project builds unless AngryParserZlib or AngryParserZstd
+// is set to true, compressed input makes the first read() throw IOException. Memory use
+// is bufferSize * bufferCount plus one input buffer, whatever the size of the output.
+class AngryParser_API XMLDecompressor
+{
+public:
+    enum class Format
+    {
+        Plain,
+        Gzip,
+        Zstd,
+    };
+
+private:
+    struct Buffer
+    {
+        std::vector<char> data;
+        std::size_t size;
+        bool full;
+    };
+
+    File file;
+    Format format;
+    std::vector<Buffer> buffers;
+    std::size_t readIndex;  // used by read() only
+    std::size_t writeIndex; // used by the thread only
+    bool held;              // read() returned buffers[readIndex], which is not yet released
+    bool finished;
+    bool stopped;
+    std::exception_ptr error;
+    std::mutex mutex;
+    std::condition_variable filled;
+    std::condition_variable emptied;
+    std::thread thread;
+
+private:
+    void run();
+
+public:
+    explicit XMLDecompressor(const char *path, std::size_t bufferSize = std::size_t(1) << 20, std::size_t bufferCount = 4);
+    XMLDecompressor(const XMLDecompressor &src) = delete;
+    ~XMLDecompressor();
+
+    XMLDecompressor &operator=(const XMLDecompressor &src) = delete;
+
+    Format getFormat() const noexcept { return format; }
+
+    // Next block of output, valid until the following call; empty at the end. An error
+    // of the decompression thread is thrown once the blocks before it are read.
+    StringView read();
+};
+
+// XMLStreamReader fed by an XMLDecompressor, so that decompression overlaps parsing.
+// Besides the ring, only the unparsed tail of the input is held, as by XMLStreamReader.
+template <XMLParser::Flag F = XMLParser::Flag::Default>
+class XMLCompressedReader
+{
+public:
+    using TokenType = typename XMLStreamReader<F>::TokenType;
+    using Attribute = typename XMLStreamReader<F>::Attribute;
+    using Status = typename XMLStreamReader<F>::Status;
+
+private:
+    XMLDecompressor source;
+    XMLStreamReader<F> stream;
+
+public:
+    explicit XMLCompressedReader(const char *path, std::size_t bufferSize = std::size_t(1) << 20, std::size_t bufferCount = 4) : source(path, bufferSize, bufferCount), stream() {}
+
+    XMLDecompressor::Format getFormat() const noexcept { return source.getFormat(); }
+
+    // Advance to the next token; false at the end of the document
+    bool next()
+    {
+        while (true)
+        {
+            switch (stream.next())
+            {
+            case Status::Token:
+                return true;
+            case Status::End:
+                return false;
+            case Status::NeedData:
+            {
+                auto data = source.read();
+                if (data.getLength())
+                    stream.append(data.getData(), data.getLength());
+                else
+                    stream.finish();
+                break;
+            }
+            }
+        }
+    }
+
+    TokenType tokenType() const noexcept { return stream.tokenType(); }
+    StringView name() const noexcept { return stream.name(); }
+    StringView value() const noexcept { return stream.value(); }
+    bool isEmptyElement() const noexcept { return stream.isEmptyElement(); }
+    std::size_t depth() const noexcept { return stream.depth(); }
+    const std::vector<Attribute> &attributes() const noexcept { return stream.attributes(); }
+
+    // Offset of the current token in the decompressed text
+    std::size_t getOffset() const noexcept { return stream.getOffset(); }
+    std::size_t getBufferSize() const noexcept { return stream.getBufferSize(); }
+};
+
+} // namespace XML
+NS_END
+
+#endif
@@ -1,112 +1,394 @@
 ﻿#include "document.h"
 
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <utility>
+#include <vector>
+
+#include "../Core/hash.h"
+#include "printer.h"
+
 NS_BEGINE
 inline namespace XML
 {
-	void XMLDocument::print(std::ostream& stream)
+	namespace
 	{
-		if (hasChildNodes())
+		template <typename T>
+		constexpr std::size_t slotSize()
 		{
+			return (sizeof(T) + alignof(std::max_align_t) - 1) & ~(alignof(std::max_align_t) - 1);
+		}
 
-			XMLNode* cur = &getFirstChild();
+		// Visits top and its descendants in document order. leave(node) is called once the
+		// children of node are done, for every node that has children.
+		template <typename Node, typename Enter, typename Leave>
+		void walk(Node& top, Enter enter, Leave leave)
+		{
+			Node* cur = &top;
 			while (true)
 			{
-
-				switch (cur->getType())
-				{
-
-				case XMLNodeType::Element:
+				enter(*cur);
+				if (cur->hasChildNodes())
 				{
-
-					auto& element = static_cast<XMLElement&>(*cur);
-					auto name = element.getName();
-					stream.write("<", 1);
-					stream.write(name.getData(), name.getLength());
-					for (auto& attr : element.attribute())
-					{
-						auto attrName = attr.getName();
-						auto attrValue = attr.getValue();
-						stream.write(" ", 1);
-						stream.write(attrName.getData(), attrName.getLength());
-						stream.write("=\"", 2);
-						stream.write(attrValue.getData(), attrValue.getLength());
-						stream.write("\"", 1);
-					}
-					bool empty = !cur->hasChildNodes();
-					{
-						if (empty)
-							stream.write("/>", 2);
-						else
-							stream.write(">", 1);
-					}
-					if (!empty)
-					{
-						cur = &cur->getFirstChild();
-						continue;
-					}
-					break;
+					cur = &cur->getFirstChild();
+					continue;
 				}
-				case XMLNodeType::Text:
+				while (cur != &top && !cur->next)
 				{
-
-					auto& text = static_cast<XMLText&>(*cur);
-					auto value = text.getValue();
-					stream.write(value.getData(), value.getLength());
-					break;
+					cur = cur->parent;
+					leave(*cur);
 				}
-				case XMLNodeType::CDATA:
-				{
-
-					auto& cdata = static_cast<XMLCDATA&>(*cur);
-					auto value = cdata.getValue();
-					stream.write("<![CDATA[", 9);
-					stream.write(value.getData(), value.getLength());
-					stream.write("]]>", 3);
+				if (cur == &top)
 					break;
-				}
-				case XMLNodeType::Comment:
-				{
+				cur = cur->next;
+			}
+		}
 
-					auto& comment = static_cast<XMLComment&>(*cur);
-					auto value = comment.getValue();
-					stream.write("<!--", 4);
-					stream.write(value.getData(), value.getLength());
-					stream.write("-->", 3);
-					break;
-				}
-				case XMLNodeType::ProcessingInstruction:
-				{
+		// Whether local is the tail of name, as the local name of a prefixed name is
+		bool isSuffix(StringView name, StringView local)
+		{
+			return local.getData() + local.getLength() == name.getData() + name.getLength();
+		}
+
+		struct StreamSink
+		{
+			std::ostream& stream;
 
-					auto& pi = static_cast<XMLProcessingInstruction&>(*cur);
-					auto name = pi.getName();
-					auto value = pi.getValue();
+			void write(const char* data, std::size_t n) { stream.write(data, n); }
+		};
 
-					stream.write("<?", 2);
-					stream.write(name.getData(), name.getLength());
-					stream.write(" ", 1);
-					stream.write(value.getData(), value.getLength());
-					stream.write("?>", 2);
+		// Seeds that keep node kinds apart
+		enum : std::uint64_t
+		{
+			ElementSeed = 1,
+			AttributeSeed,
+			TextSeed,
+			CDATASeed,
+			CommentSeed,
+			ProcessingInstructionSeed,
+			DocumentSeed,
+		};
+
+		std::uint64_t hashView(StringView value, std::uint64_t seed)
+		{
+			return hashBytes(value.getData(), value.getLength(), seed);
+		}
+
+		// Name and attributes of element, the latter in an order of their own so that
+		// attribute order does not count
+		std::uint64_t hashShallow(const XMLElement& element, std::vector<std::uint64_t>& attributes)
+		{
+			attributes.clear();
+			for (auto& attr : element.attribute())
+				attributes.push_back(hashCombine(hashView(attr.getName(), AttributeSeed), hashView(attr.getValue(), AttributeSeed)));
+			std::sort(attributes.begin(), attributes.end());
+			auto hash = hashView(element.getName(), ElementSeed);
+			for (auto value : attributes)
+				hash = hashCombine(hash, value);
+			return hashCombine(hash, attributes.size());
+		}
+
+		// Hash of a child; elements must have theirs computed already
+		std::uint64_t hashChild(const XMLNode& node)
+		{
+			switch (node.getType())
+			{
+			case XMLNodeType::Element:
+				return node.asElement().getHash();
+			case XMLNodeType::Text:
+				return hashView(node.asText().getValue(), TextSeed);
+			case XMLNodeType::CDATA:
+				return hashView(node.asCDATA().getValue(), CDATASeed);
+			case XMLNodeType::Comment:
+				return hashView(node.asComment().getValue(), CommentSeed);
+			case XMLNodeType::ProcessingInstruction:
+				return hashCombine(hashView(node.asProcessingInstruction().getName(), ProcessingInstructionSeed), hashView(node.asProcessingInstruction().getValue(), ProcessingInstructionSeed));
+			default:
+				return 0;
+			}
+		}
+
+		std::uint64_t hashChildren(std::uint64_t hash, const XMLNode& node)
+		{
+			std::size_t count = 0;
+			for (auto& child : node.children())
+			{
+				hash = hashCombine(hash, hashChild(child));
+				++count;
+			}
+			return hashCombine(hash, count);
+		}
+
+		// Occurrences of '<' and '=' in [p, p + n), eight bytes at a time
+		void countMarkup(const char* p, std::size_t n, std::size_t& tags, std::size_t& equals) noexcept
+		{
+			const std::uint64_t ones = 0x0101010101010101ull, low = 0x7F7F7F7F7F7F7F7Full;
+			// High bit of every byte of w that equals c; the sum of those bits, byte by byte
+			auto count = [&](std::uint64_t w, char c)
+			{
+				auto x = w ^ (ones * static_cast<unsigned char>(c));
+				auto zero = ~(((x & low) + low) | x | low);
+				return static_cast<std::size_t>(((zero >> 7) * ones) >> 56);
+			};
+			std::size_t i = 0;
+			for (; i + 8 <= n; i += 8)
+			{
+				std::uint64_t w;
+				std::memcpy(&w, p + i, 8);
+				tags += count(w, '<');
+				equals += count(w, '=');
+			}
+			for (; i < n; ++i)
+			{
+				tags += p[i] == '<';
+				equals += p[i] == '=';
+			}
+		}
+
+		// Outermost differing nodes below a and b, whose hashes differ. A node whose own
+		// content differs, or whose children differ in number, kind or anything but an
+		// element, is reported as a whole; otherwise the search continues in the children.
+		void diffNodes(const XMLNode& a, const XMLNode& b, std::vector<std::uint64_t>& attributes, std::vector<std::pair<const XMLNode*, const XMLNode*>>& changes)
+		{
+			if (a.getType() == XMLNodeType::Element && hashShallow(a.asElement(), attributes) != hashShallow(b.asElement(), attributes))
+			{
+				changes.emplace_back(&a, &b);
+				return;
+			}
+			auto x = a.children().begin(), xEnd = a.children().end();
+			auto y = b.children().begin(), yEnd = b.children().end();
+			for (; x != xEnd && y != yEnd; ++x, ++y)
+			{
+				if (x->getType() != y->getType() || (x->getType() != XMLNodeType::Element && hashChild(*x) != hashChild(*y)))
 					break;
-				}
-				default:
-					throw XMLDOMException("Invalid node type");
-				}
-				while (!cur->next)
-				{
+			}
+			if (x != xEnd || y != yEnd)
+			{
+				changes.emplace_back(&a, &b);
+				return;
+			}
+			for (x = a.children().begin(), y = b.children().begin(); x != xEnd; ++x, ++y)
+			{
+				if (x->getType() == XMLNodeType::Element && x->asElement().getHash() != y->asElement().getHash())
+					diffNodes(*x, *y, attributes, changes);
+			}
+		}
 
-					cur = cur->parent;
-					if (cur == this)
-						break;
-					auto name = static_cast<XMLElement*>(cur)->getName();
+		// Hands out nodes and strings from one block sized by a counting pass
+		class Packer
+		{
+		public:
+			Packer(char* nodes_, char* strings_) : nodes(nodes_), strings(strings_) {}
+
+			template <typename T, typename... Args>
+			T& create(Args&&... args)
+			{
+				auto p = nodes;
+				nodes += slotSize<T>();
+				return *new(p) T(std::forward<Args>(args)...);
+			}
+			StringView copy(StringView value)
+			{
+				auto p = strings;
+				if (value.getLength())
+					std::memcpy(p, value.getData(), value.getLength());
+				strings += value.getLength();
+				return StringView(p, value.getLength());
+			}
+			// Copy name, sharing the copy with localName when it is the tail of name
+			XMLQualifiedName copy(StringView name, StringView localName, XMLNamespace uri)
+			{
+				auto copied = copy(name);
+				if (isSuffix(name, localName))
+					return {copied, StringView(copied.getData() + copied.getLength() - localName.getLength(), localName.getLength()), uri};
+				return {copied, copy(localName), uri};
+			}
+
+		private:
+			char* nodes;
+			char* strings;
+		};
+	}
 
-					stream.write("</", 2);
-					stream.write(name.getData(), name.getLength());
-					stream.write(">", 1);
+	StringView XMLDocument::decodeBase64(StringView value)
+	{
+		auto capacity = getBase64DecodedSize(value.getLength());
+		auto data = capacity ? static_cast<unsigned char*>(allocator.allocate(capacity, 1)) : nullptr;
+		return StringView(reinterpret_cast<const char*>(data), Impl::base64Value(value, data));
+	}
+
+	void XMLDocument::presize(const char* data, std::size_t length) noexcept
+	{
+		const std::size_t window = 8192, windows = 8;
+		if (length < window * windows)
+			return;
+		std::size_t tags = 0, equals = 0;
+		for (std::size_t i = 0; i < windows; ++i)
+			countMarkup(data + (length - window) / (windows - 1) * i, window, tags, equals);
+		// An element has a start and an end tag and usually a text node. An eighth more, as
+		// an estimate that falls just short costs a whole further block.
+		auto scale = static_cast<double>(length) / (window * windows) * 1.125;
+		auto size = (tags / 2 * (sizeof(XMLElement) + sizeof(XMLText)) + equals * sizeof(XMLAttribute)) * scale;
+		try
+		{
+			allocator.reserve(static_cast<std::size_t>(size));
+		}
+		catch (const std::bad_alloc&)
+		{
+		}
+		catch (const LimitExceededException&)
+		{
+		}
+	}
+
+	std::uint64_t XMLDocument::computeHash()
+	{
+		std::vector<std::uint64_t> attributes;
+		walk<XMLNode>(*this, [&](XMLNode& node)
+		{
+			if (node.getType() == XMLNodeType::Element && !node.hasChildNodes())
+				node.asElement().hash = hashChildren(hashShallow(node.asElement(), attributes), node);
+		}, [&](XMLNode& node)
+		{
+			if (node.getType() == XMLNodeType::Element)
+				node.asElement().hash = hashChildren(hashShallow(node.asElement(), attributes), node);
+		});
+		hash = hashChildren(DocumentSeed, *this);
+		return hash;
+	}
+
+	void XMLDocument::diff(const XMLDocument& other, std::vector<std::pair<const XMLNode*, const XMLNode*>>& changes) const
+	{
+		changes.clear();
+		if (hash == other.hash)
+			return;
+		std::vector<std::uint64_t> attributes;
+		diffNodes(*this, other, attributes, changes);
+	}
+
+	void XMLDocument::assign(const XMLNode& node)
+	{
+		auto root = &node;
+		while (root->parent)
+			root = root->parent;
+		if (root == this)
+			throw XMLDOMException("Cannot assign a subtree of the document to itself");
+		auto source = root->getType() == XMLNodeType::Document ? &root->asDocument().namespaces : nullptr;
+		auto remap = [&](XMLNamespace uri)
+		{
+			if (static_cast<std::uint32_t>(uri) <= static_cast<std::uint32_t>(XMLNamespace::XMLNS))
+				return uri;
+			if (!source)
+				throw XMLDOMException("Namespace table not found");
+			return namespaces.intern(source->getURI(uri));
+		};
+
+		// Counting pass, which also interns the namespaces before anything is cleared
+		std::size_t nodeSize = 0;
+		std::size_t stringSize = 0;
+		auto addName = [&](StringView name, StringView localName, XMLNamespace uri)
+		{
+			remap(uri);
+			stringSize += name.getLength();
+			if (!isSuffix(name, localName))
+				stringSize += localName.getLength();
+		};
+		walk(node, [&](const XMLNode& cur)
+		{
+			switch (cur.getType())
+			{
+			case XMLNodeType::Element:
+			{
+				auto& element = cur.asElement();
+				nodeSize += slotSize<XMLElement>();
+				addName(element.getName(), element.getLocalName(), element.getNamespace());
+				for (auto& attr : element.attribute())
+				{
+					nodeSize += slotSize<XMLAttribute>();
+					addName(attr.getName(), attr.getLocalName(), attr.getNamespace());
+					stringSize += attr.getValue().getLength();
 				}
-				if (cur == this)
-					break;
-				cur = cur->next;
+				break;
 			}
+			case XMLNodeType::Text:
+				nodeSize += slotSize<XMLText>();
+				stringSize += cur.asText().getValue().getLength();
+				break;
+			case XMLNodeType::CDATA:
+				nodeSize += slotSize<XMLCDATA>();
+				stringSize += cur.asCDATA().getValue().getLength();
+				break;
+			case XMLNodeType::Comment:
+				nodeSize += slotSize<XMLComment>();
+				stringSize += cur.asComment().getValue().getLength();
+				break;
+			case XMLNodeType::ProcessingInstruction:
+				nodeSize += slotSize<XMLProcessingInstruction>();
+				stringSize += cur.asProcessingInstruction().getName().getLength() + cur.asProcessingInstruction().getValue().getLength();
+				break;
+			default:
+				break;
+			}
+		}, [](const XMLNode&) {});
+
+		clear();
+		if (!nodeSize)
+			return;
+		auto block = static_cast<char*>(allocator.allocateExact(nodeSize + stringSize));
+		Packer packer(block, block + nodeSize);
+		XMLNode* cur = this;
+		walk(node, [&](const XMLNode& src)
+		{
+			XMLNode* copy;
+			switch (src.getType())
+			{
+			case XMLNodeType::Element:
+			{
+				auto& element = src.asElement();
+				auto& target = packer.create<XMLElement>(packer.copy(element.getName(), element.getLocalName(), remap(element.getNamespace())));
+				for (auto& attr : element.attribute())
+					target.appendAttribute(packer.create<XMLAttribute>(packer.copy(attr.getName(), attr.getLocalName(), remap(attr.getNamespace())), packer.copy(attr.getValue())));
+				copy = &target;
+				break;
+			}
+			case XMLNodeType::Text:
+				copy = &packer.create<XMLText>(packer.copy(src.asText().getValue()));
+				break;
+			case XMLNodeType::CDATA:
+				copy = &packer.create<XMLCDATA>(packer.copy(src.asCDATA().getValue()));
+				break;
+			case XMLNodeType::Comment:
+				copy = &packer.create<XMLComment>(packer.copy(src.asComment().getValue()));
+				break;
+			case XMLNodeType::ProcessingInstruction:
+			{
+				auto name = packer.copy(src.asProcessingInstruction().getName());
+				auto value = packer.copy(src.asProcessingInstruction().getValue());
+				copy = &packer.create<XMLProcessingInstruction>(name, value);
+				break;
+			}
+			default:
+				return;
+			}
+			cur->appendChild(*copy);
+			if (src.hasChildNodes())
+				cur = copy;
+		}, [&](const XMLNode& src)
+		{
+			if (&src != &node)
+				cur = cur->parent;
+		});
+	}
+
+	void XMLDocument::print(std::ostream& stream) const
+	{
+		if (hasChildNodes())
+		{
+			StreamSink sink{ stream };
+			for (auto& child : children())
+				Impl::printNode(child, sink);
 			stream.flush();
 		}
 	}
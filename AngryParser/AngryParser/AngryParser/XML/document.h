@@ -4,14 +4,20 @@
 #include <cassert>
 #include <cstring>
 
+#include <cstdint>
 #include <new>
+#include <type_traits>
 #include <iostream>
+#include <utility>
+#include <vector>
 
 #include "../Core/compilerdetection.h"
 
 #include "../Core/string.h"
 #include "../Core/exception.h"
 #include "../Core/allocator.h"
+#include "../Core/base64.h"
+#include "../Core/number.h"
 #include "Handler.h"
 #include "Parser.h"
 
@@ -41,51 +47,58 @@ inline namespace XML
 				ListElement() : prev(), next(), parent() {}
 			};
 
-			class Iterator
+			template <typename U>
+			class BasicIterator
 			{
+				using ListType = std::conditional_t<std::is_const<U>::value, const List, List>;
+				using ElementType = std::conditional_t<std::is_const<U>::value, const ListElement, ListElement>;
+
 			public:
-				Iterator(List* list_, ListElement* p_) : list(list_), p(p_) {}
-				Iterator(const Iterator& src) : list(src.list), p(src.p) {}
+				BasicIterator(ListType* list_, ElementType* p_) : list(list_), p(p_) {}
+				BasicIterator(const BasicIterator& src) : list(src.list), p(src.p) {}
 
-				Iterator& operator=(const Iterator& src)
+				BasicIterator& operator=(const BasicIterator& src)
 				{
 					list = src.list, p = src.p;
 					return *this;
 				}
 
-				T& operator*() const { return static_cast<T&>(*p); }
-				T* operator->() const { return static_cast<T*>(p); }
-				bool operator==(const Iterator& it) { return p == it.p; }
-				bool operator==(XMLNode* q) { return p == q; }
-				bool operator!=(const Iterator& it) { return p != it.p; }
-				Iterator& operator++()
+				U& operator*() const { return static_cast<U&>(*p); }
+				U* operator->() const { return static_cast<U*>(p); }
+				bool operator==(const BasicIterator& it) { return p == it.p; }
+				bool operator==(const XMLNode* q) { return p == q; }
+				bool operator!=(const BasicIterator& it) { return p != it.p; }
+				BasicIterator& operator++()
 				{
 					p = p->next;
 					return *this;
 				}
-				Iterator operator++(int)
+				BasicIterator operator++(int)
 				{
-					Iterator tmp = *this;
+					BasicIterator tmp = *this;
 					++* this;
 					return tmp;
 				}
-				Iterator& operator--()
+				BasicIterator& operator--()
 				{
 					p = p ? p->prev : list->last;
 					return *this;
 				}
-				Iterator operator--(int)
+				BasicIterator operator--(int)
 				{
-					Iterator tmp = *this;
+					BasicIterator tmp = *this;
 					--* this;
 					return tmp;
 				}
 
 			private:
-				List* list;
-				ListElement* p;
+				ListType* list;
+				ElementType* p;
 			};
 
+			using Iterator = BasicIterator<T>;
+			using ConstIterator = BasicIterator<const T>;
+
 		public:
 			List() : first(), last() {}
 			List(const List& src) = delete;
@@ -119,6 +132,24 @@ inline namespace XML
 				return child;
 			}
 
+			// Put child in the place of ref. ref keeps its own links, which still say where it was.
+			T& replace(T& child, T& ref)
+			{
+				assert(!child.parent && ref.parent);
+				child.prev = ref.prev;
+				child.next = ref.next;
+				child.parent = ref.parent;
+				if (ref.prev)
+					ref.prev->next = &child;
+				else
+					first = &child;
+				if (ref.next)
+					ref.next->prev = &child;
+				else
+					last = &child;
+				return child;
+			}
+
 			T& remove(T& child)
 			{
 				auto pPrev = child.prev;
@@ -138,12 +169,17 @@ inline namespace XML
 			}
 
 			T& getFirst() { return *first; }
+			const T& getFirst() const { return *first; }
 			T& getLast() { return *last; }
+			const T& getLast() const { return *last; }
 
 			bool empty() const { return !first; }
+			void clear() { first = last = nullptr; }
 
 			Iterator begin() { return Iterator(this, first); }
 			Iterator end() { return Iterator(this, nullptr); }
+			ConstIterator begin() const { return ConstIterator(this, first); }
+			ConstIterator end() const { return ConstIterator(this, nullptr); }
 
 		private:
 			T* first;
@@ -155,9 +191,39 @@ inline namespace XML
 	class XMLDOMException : public Exception
 	{
 	public:
-		XMLDOMException(const StringView& data) : Exception("XMLDOMException: " + data) {}
+		XMLDOMException(const StringView& data) : Exception("XMLDOMException: ", data) {}
 	};
 
+	namespace Impl
+	{
+		template <typename T>
+		T valueAs(StringView value)
+		{
+			T result;
+			if (!parseNumber(value, result))
+				throw XMLDOMException("Value is not a number of the requested type");
+			return result;
+		}
+
+		template <typename T>
+		std::size_t valuesAs(StringView value, T* out, std::size_t capacity)
+		{
+			auto count = capacity;
+			if (parseNumbers(value.begin(), value.end(), out, count) != value.end())
+				throw XMLDOMException(count == capacity ? "Value holds more numbers than fit" : "Value is not a list of numbers of the requested type");
+			return count;
+		}
+
+		inline std::size_t base64Value(StringView value, unsigned char* out)
+		{
+			std::size_t size;
+			if (!decodeBase64(value, out, size))
+				throw XMLDOMException("Value is not Base64");
+			return size;
+		}
+
+	} // namespace Impl
+
 	enum class XMLNodeType : uint16_t
 	{
 		Element,
@@ -177,14 +243,18 @@ inline namespace XML
 		XMLNodeType getType() const { return type; }
 
 		Impl::List<XMLNode>& children() { return listChild; }
+		const Impl::List<XMLNode>& children() const { return listChild; }
 
 		XMLNode& getFirstChild() { return listChild.getFirst(); }
+		const XMLNode& getFirstChild() const { return listChild.getFirst(); }
 		XMLNode& getLastChild() { return listChild.getLast(); }
+		const XMLNode& getLastChild() const { return listChild.getLast(); }
 
 		XMLNode& appendChild(XMLNode& child) { return listChild.append(*this, child); }
 		XMLNode& insertBefore(XMLNode& child, XMLNode& ref) { return listChild.insertBefore(child, ref); }
+		XMLNode& replaceChild(XMLNode& child, XMLNode& ref) { return listChild.replace(child, ref); }
 		XMLNode& removeChild(XMLNode& child) { return listChild.remove(child); }
-		bool hasChildNodes() { return !listChild.empty(); }
+		bool hasChildNodes() const { return !listChild.empty(); }
 
 		XMLElement& asElement() noexcept { return reinterpret_cast<XMLElement&>(*this); }
 		const XMLElement& asElement() const noexcept { return reinterpret_cast<const XMLElement&>(*this); }
@@ -207,40 +277,76 @@ inline namespace XML
 	class AngryParser_API XMLAttribute : public Impl::List<XMLAttribute>::ListElement
 	{
 	public:
-		XMLAttribute() : Impl::List<XMLAttribute>::ListElement(), name(), value() {}
-		XMLAttribute(StringView name_, StringView value_) : Impl::List<XMLAttribute>::ListElement(), name(name_), value(value_) {}
+		XMLAttribute() : Impl::List<XMLAttribute>::ListElement(), name(), localName(), uri(), value() {}
+		XMLAttribute(StringView name_, StringView value_) : Impl::List<XMLAttribute>::ListElement(), name(name_), localName(name_), uri(), value(value_) {}
+		XMLAttribute(const XMLQualifiedName& name_, StringView value_) : Impl::List<XMLAttribute>::ListElement(), name(name_.name), localName(name_.localName), uri(name_.uri), value(value_) {}
 		XMLAttribute(const XMLAttribute& src) = delete;
 
 		StringView getName() const { return name; }
-		void setName(StringView name_) { name = name_; }
+		void setName(StringView name_) { name = localName = name_; uri = XMLNamespace::None; }
 		StringView getValue() const { return value; }
 		void setValue(StringView value_) { value = value_; }
 
+		// The value as a number, see parseNumber; throws XMLDOMException if it is not one
+		template <typename T>
+		T getValueAs() const { return Impl::valueAs<T>(value); }
+		template <typename T>
+		bool tryGetValueAs(T& result) const noexcept { return parseNumber(value, result); }
+		// Parse the whitespace-separated numbers of the value into out, which has room for
+		// capacity of them, and return how many there were. Throws XMLDOMException if the
+		// value holds anything else or more numbers than that.
+		template <typename T>
+		std::size_t getValuesAs(T* out, std::size_t capacity) const { return Impl::valuesAs(value, out, capacity); }
+
+		// Set only when parsed with XMLParser::Flag::Namespaces; otherwise the local name is the name
+		StringView getLocalName() const { return localName; }
+		XMLNamespace getNamespace() const { return uri; }
+		bool matches(XMLNamespace uri_, StringView localName_) const { return uri == uri_ && localName == localName_; }
+
 	private:
 		StringView name;
+		StringView localName;
+		XMLNamespace uri;
 		StringView value;
 	};
 
 	class AngryParser_API XMLElement : public XMLNode
 	{
 	public:
-		XMLElement() : XMLNode(XMLNodeType::Element), listAttr(), name() {}
-		XMLElement(StringView name_) : XMLNode(XMLNodeType::Element), listAttr(), name(name_) {}
+		XMLElement() : XMLNode(XMLNodeType::Element), listAttr(), name(), localName(), uri(), hash() {}
+		XMLElement(StringView name_) : XMLNode(XMLNodeType::Element), listAttr(), name(name_), localName(name_), uri(), hash() {}
+		XMLElement(const XMLQualifiedName& name_) : XMLNode(XMLNodeType::Element), listAttr(), name(name_.name), localName(name_.localName), uri(name_.uri), hash() {}
 		XMLElement(const XMLElement& src) = delete;
 
 		Impl::List<XMLAttribute>& attribute() { return listAttr; }
+		const Impl::List<XMLAttribute>& attribute() const { return listAttr; }
 
 		StringView getName() const { return name; }
-		void setName(StringView name_) { name = name_; }
+		void setName(StringView name_) { name = localName = name_; uri = XMLNamespace::None; }
+
+		// Set only when parsed with XMLParser::Flag::Namespaces; otherwise the local name is the name
+		StringView getLocalName() const { return localName; }
+		XMLNamespace getNamespace() const { return uri; }
+		bool matches(XMLNamespace uri_, StringView localName_) const { return uri == uri_ && localName == localName_; }
 
 		XMLAttribute& getFirstAttribute() { return listAttr.getFirst(); }
+		const XMLAttribute& getFirstAttribute() const { return listAttr.getFirst(); }
 		XMLAttribute& getLastAttribute() { return listAttr.getLast(); }
+		const XMLAttribute& getLastAttribute() const { return listAttr.getLast(); }
 		XMLAttribute& appendAttribute(XMLAttribute& attr) { return listAttr.append(*this, attr); }
 		XMLAttribute& removeAttribute(XMLAttribute& attr) { return listAttr.remove(attr); }
 
+		// Set by XMLDocument::computeHash
+		std::uint64_t getHash() const { return hash; }
+
 	private:
+		friend class XMLDocument;
+
 		Impl::List<XMLAttribute> listAttr;
 		StringView name;
+		StringView localName;
+		XMLNamespace uri;
+		std::uint64_t hash;
 	};
 
 	class AngryParser_API XMLText : public XMLNode
@@ -253,6 +359,28 @@ inline namespace XML
 		StringView getValue() const { return value; }
 		void setValue(StringView value_) { value = value_; }
 
+		// The value as a number, see parseNumber; throws XMLDOMException if it is not one
+		template <typename T>
+		T getValueAs() const { return Impl::valueAs<T>(value); }
+		template <typename T>
+		bool tryGetValueAs(T& result) const noexcept { return parseNumber(value, result); }
+		// Parse the whitespace-separated numbers of the value into out, which has room for
+		// capacity of them, and return how many there were. Throws XMLDOMException if the
+		// value holds anything else or more numbers than that.
+		template <typename T>
+		std::size_t getValuesAs(T* out, std::size_t capacity) const { return Impl::valuesAs(value, out, capacity); }
+
+		// Decode the value as Base64 into out, which needs getBase64DecodedSize() of its
+		// length, and return the number of bytes; throws XMLDOMException if it is not Base64
+		std::size_t getValueAsBase64(unsigned char* out) const { return Impl::base64Value(value, out); }
+		// Decode the value where it is and make the bytes the value. The document must have
+		// been parsed from a writable buffer, not with XMLParser::Flag::NonDestructive.
+		StringView decodeBase64InPlace()
+		{
+			auto data = const_cast<char*>(value.getData());
+			value = StringView(data, Impl::base64Value(value, reinterpret_cast<unsigned char*>(data)));
+			return value;
+		}
 	private:
 		StringView value;
 	};
@@ -267,6 +395,18 @@ inline namespace XML
 		StringView getValue() const { return value; }
 		void setValue(StringView value_) { value = value_; }
 
+		// Decode the value as Base64 into out, which needs getBase64DecodedSize() of its
+		// length, and return the number of bytes; throws XMLDOMException if it is not Base64
+		std::size_t getValueAsBase64(unsigned char* out) const { return Impl::base64Value(value, out); }
+		// Decode the value where it is and make the bytes the value. The document must have
+		// been parsed from a writable buffer, not with XMLParser::Flag::NonDestructive.
+		StringView decodeBase64InPlace()
+		{
+			auto data = const_cast<char*>(value.getData());
+			value = StringView(data, Impl::base64Value(value, reinterpret_cast<unsigned char*>(data)));
+			return value;
+		}
+
 	private:
 		StringView value;
 	};
@@ -305,17 +445,25 @@ inline namespace XML
 	class AngryParser_API XMLDocument : public XMLNode
 	{
 	public:
-		XMLDocument() : XMLNode(XMLNodeType::Document), allocator() {}
+		XMLDocument() : XMLNode(XMLNodeType::Document), allocator(), namespaces(), limits(), usage(), hash() {}
 		XMLDocument(const XMLDocument& src) = delete;
 
 		XMLElement& createElement(StringView name)
 		{
 			return *new(allocator.allocate(sizeof(XMLElement))) XMLElement(name);
 		}
+		XMLElement& createElement(const XMLQualifiedName& name)
+		{
+			return *new(allocator.allocate(sizeof(XMLElement))) XMLElement(name);
+		}
 		XMLAttribute& createAttribute(StringView name, StringView value)
 		{
 			return *new(allocator.allocate(sizeof(XMLAttribute))) XMLAttribute(name, value);
 		}
+		XMLAttribute& createAttribute(const XMLQualifiedName& name, StringView value)
+		{
+			return *new(allocator.allocate(sizeof(XMLAttribute))) XMLAttribute(name, value);
+		}
 		XMLText& createText(StringView value)
 		{
 			return *new(allocator.allocate(sizeof(XMLText))) XMLText(value);
@@ -336,9 +484,23 @@ inline namespace XML
 
 		void clear()
 		{
+			children().clear();
 			allocator.clear();
+			usage = Usage();
+		}
+		// Like clear(), but keeps the arena's blocks for the next parse
+		void reset()
+		{
+			children().clear();
+			allocator.reset();
+			usage = Usage();
 		}
 
+		// Replace the content with a deep copy of node, or of the children of node if it is
+		// a document, so that nothing refers to the source buffer or document any more. Nodes
+		// and strings are packed into one block of exactly the size they need.
+		void assign(const XMLNode& node);
+
 		XMLElement& getRootElement()
 		{
 			for (auto& node : children())
@@ -346,72 +508,231 @@ inline namespace XML
 					return static_cast<XMLElement&>(node);
 			throw XMLDOMException("Root element not found");
 		}
+		const XMLElement& getRootElement() const
+		{
+			for (auto& node : children())
+				if (node.getType() == XMLNodeType::Element)
+					return static_cast<const XMLElement&>(node);
+			throw XMLDOMException("Root element not found");
+		}
+
+		// Namespace ids of elements and attributes refer to this table, which is kept across
+		// parses; intern a URI here to compare against them
+		XMLNamespaceTable& getNamespaces() noexcept { return namespaces; }
+		const XMLNamespaceTable& getNamespaces() const noexcept { return namespaces; }
+
+		// Compute a hash of every element from its name, its attributes in any order and the
+		// hashes of its children, and return the hash of the document. The hashes are kept
+		// until the next call; changes to the tree are not tracked.
+		std::uint64_t computeHash();
+		std::uint64_t getHash() const noexcept { return hash; }
+
+		// Pairs of corresponding nodes, this document's first, that contain every difference
+		// from other. Subtrees with equal hashes are skipped, so the cost follows the size of
+		// the changes. Both documents need their hashes computed.
+		void diff(const XMLDocument& other, std::vector<std::pair<const XMLNode*, const XMLNode*>>& changes) const;
+
+		// Decode value as Base64 into the arena and return the bytes, which stay valid until
+		// the next parse or clear(); throws XMLDOMException if it is not Base64
+		StringView decodeBase64(StringView value);
+
+		std::size_t getArenaUsed() const noexcept { return allocator.getUsedSize(); }
+		std::size_t getArenaReserved() const noexcept { return allocator.getReservedSize(); }
+
+		// What the last parse built: nodes other than attributes, attributes, and the
+		// deepest nesting of elements. The arena's size is given by getArenaReserved().
+		struct Usage
+		{
+			std::size_t nodes;
+			std::size_t attributes;
+			std::size_t depth;
+		};
+		const Usage& getUsage() const noexcept { return usage; }
+
+		// Bounds on every parse, checked by the parser as it goes; a document that passes
+		// one fails with DepthLimitExceeded, ElementLimitExceeded or AttributeLimitExceeded
+		const XMLParser::Limits& getLimits() const noexcept { return limits; }
+		void setLimits(const XMLParser::Limits& limits_) noexcept { limits = limits_; }
+		// Most bytes the arena may take from the system, or 0 for no limit. A parse that
+		// needs more fails with MemoryLimitExceeded; nodes created directly throw
+		// LimitExceededException. Blocks the arena already holds stay until clear().
+		void setArenaLimit(std::size_t bytes) noexcept { allocator.setLimit(bytes); }
+		std::size_t getArenaLimit() const noexcept { return allocator.getLimit(); }
+
+		// Back large arena blocks with huge pages, which cuts TLB misses when walking a big tree
+		void setHugePages(bool enabled) noexcept { allocator.setHugePages(enabled); }
 
 		template <XMLParser::Flag F = XMLParser::Flag::Default>
 		void parse(char* data)
 		{
-			class Handler : public XMLHandlerBase
-			{
-			public:
-				Handler(XMLDocument* document_) : document(document_), cur(nullptr) {}
+			XMLParser parser(allocator, namespaces);
+			parseDocument<F>(data, parser);
+		}
 
-				void startDocument() { cur = document; }
-				void startElement(StringView name)
-				{
-					auto& element = document->createElement(name);
-					cur->appendChild(element);
-					cur = &element;
-				}
-				void endElement(StringView /*name*/)
-				{
-					cur = cur->parent;
-				}
-				void endAttributes(bool empty)
-				{
-					if (empty)
-						cur = cur->parent;
-				}
-				void attribute(StringView name, StringView value)
-				{
-					static_cast<XMLElement*>(cur)->appendAttribute(document->createAttribute(name, value));
-				}
-				void text(StringView value)
-				{
-					cur->appendChild(document->createText(value));
-				}
-				void cdata(StringView value)
-				{
-					cur->appendChild(document->createCDATA(value));
-				}
-				void comment(StringView value)
-				{
-					cur->appendChild(document->createComment(value));
-				}
-				void processingInstruction(StringView name, StringView value)
-				{
-					cur->appendChild(document->createProcessingInstruction(name, value));
-				}
+		template <XMLParser::Flag F = XMLParser::Flag::Default>
+		void parse(char* data, XMLParser::Statistics& statistics)
+		{
+			XMLParser parser(allocator, namespaces);
+			parseDocument<F | XMLParser::Flag::Statistics>(data, parser);
+			statistics = parser.getStatistics();
+		}
 
-			private:
-				XMLDocument* document;
-				XMLNode* cur;
-			};
+		// Read-only input, parsed with XMLParser::Flag::NonDestructive. The document refers
+		// into data, which must outlive it.
+		template <XMLParser::Flag F = XMLParser::Flag::Default>
+		void parse(const char* data)
+		{
+			XMLParser parser(allocator, namespaces);
+			parseDocument<F | XMLParser::Flag::NonDestructive>(const_cast<char*>(data), parser);
+		}
 
+		template <XMLParser::Flag F = XMLParser::Flag::Default>
+		void parse(const char* data, XMLParser::Statistics& statistics)
+		{
+			XMLParser parser(allocator, namespaces);
+			parseDocument<F | XMLParser::Flag::NonDestructive | XMLParser::Flag::Statistics>(const_cast<char*>(data), parser);
+			statistics = parser.getStatistics();
+		}
+
+		// Exception-free parse; on failure the document holds whatever was built before the error
+		template <XMLParser::Flag F = XMLParser::Flag::Default>
+		XMLParseResult tryParse(char* data) noexcept
+		{
 			assert(data);
 
-			clear();
-			XMLParser parser;
+			reset();
+			XMLParser parser(allocator, namespaces);
+			parser.setLimits(limits);
 			Handler handler(this);
-			parser.parse<F>(data, handler);
+			return parser.tryParse<F>(data, handler);
 		}
+		template <XMLParser::Flag F = XMLParser::Flag::Default>
+		XMLParseResult tryParse(const char* data) noexcept
+		{
+			assert(data);
 
-		void print(std::ostream& stream);
+			reset();
+			XMLParser parser(allocator, namespaces);
+			parser.setLimits(limits);
+			Handler handler(this);
+			return parser.tryParse<F>(data, handler);
+		}
+
+		void print(std::ostream& stream) const;
+
+		// Reserve the arena for the nodes that data[0, length) is estimated to hold, from the
+		// density of '<' and '=' in samples of it, so that a large input does not grow it
+		// block by block. Call before parsing data when its length is known; parse itself
+		// does not measure the input. Only a hint: if the memory cannot be had the parse
+		// grows the arena as it goes.
+		void presize(const char* data, std::size_t length) noexcept;
 
 	private:
+
+		template <XMLParser::Flag F>
+		void parseDocument(char* data, XMLParser& parser)
+		{
+			assert(data);
+
+			reset();
+			parser.setLimits(limits);
+			Handler handler(this);
+			parser.parse<F>(data, handler);
+		}
+
+	private:
+		class Handler : public XMLHandlerBase
+		{
+		public:
+			Handler(XMLDocument* document_) : document(document_), cur(nullptr), usage(document_->usage), depth() {}
+
+			void startDocument() { cur = document; }
+			void startElement(StringView name)
+			{
+				auto& element = document->createElement(name);
+				cur->appendChild(element);
+				cur = &element;
+				enter();
+			}
+			void startElementNS(const XMLQualifiedName& name)
+			{
+				auto& element = document->createElement(name);
+				cur->appendChild(element);
+				cur = &element;
+				enter();
+			}
+			void endElement(StringView /*name*/)
+			{
+				cur = cur->parent;
+				--depth;
+			}
+			void endElementNS(const XMLQualifiedName& /*name*/)
+			{
+				cur = cur->parent;
+				--depth;
+			}
+			void endAttributes(bool empty)
+			{
+				if (empty)
+				{
+					cur = cur->parent;
+					--depth;
+				}
+			}
+			void attribute(StringView name, StringView value)
+			{
+				static_cast<XMLElement*>(cur)->appendAttribute(document->createAttribute(name, value));
+				++usage.attributes;
+			}
+			void attributeNS(const XMLQualifiedName& name, StringView value)
+			{
+				static_cast<XMLElement*>(cur)->appendAttribute(document->createAttribute(name, value));
+				++usage.attributes;
+			}
+			void text(StringView value)
+			{
+				cur->appendChild(document->createText(value));
+				++usage.nodes;
+			}
+			void cdata(StringView value)
+			{
+				cur->appendChild(document->createCDATA(value));
+				++usage.nodes;
+			}
+			void comment(StringView value)
+			{
+				cur->appendChild(document->createComment(value));
+				++usage.nodes;
+			}
+			void processingInstruction(StringView name, StringView value)
+			{
+				cur->appendChild(document->createProcessingInstruction(name, value));
+				++usage.nodes;
+			}
+
+		private:
+			void enter() noexcept
+			{
+				++usage.nodes;
+				if (++depth > usage.depth)
+					usage.depth = depth;
+			}
+
+		private:
+			XMLDocument* document;
+			XMLNode* cur;
+			Usage& usage;
+			std::size_t depth;
+		};
+
 		Allocator allocator;
+		XMLNamespaceTable namespaces;
+		XMLParser::Limits limits;
+		Usage usage;
+		std::uint64_t hash;
 	};
 
-	inline std::ostream& operator<<(std::ostream& stream, XMLDocument& document)
+	inline std::ostream& operator<<(std::ostream& stream, const XMLDocument& document)
 	{
 		document.print(stream);
 		return stream;
@@ -0,0 +1,88 @@
+﻿#include "entity.h"
+
+#include <algorithm>
+
+#include "../Core/hash.h"
+
+NS_BEGINE
+inline namespace XML
+{
+	bool XMLEntityTable::insert(StringView name, StringView value)
+	{
+		if ((count + 1) * 2 > slots.size())
+			grow();
+		auto hash = name.getHash();
+		auto mask = slots.size() - 1;
+		for (auto i = static_cast<std::size_t>(hash) & mask;; i = (i + 1) & mask)
+		{
+			auto& slot = slots[i];
+			if (!slot.name.getData())
+			{
+				slot.name = name;
+				slot.value = value;
+				slot.hash = hash;
+				slot.simple = std::find(value.begin(), value.end(), '&') == value.end();
+				slot.expanding = false;
+				++count;
+				return true;
+			}
+			if (slot.hash == hash && slot.name == name)
+				return false;
+		}
+	}
+
+	const XMLEntityTable::Entity* XMLEntityTable::find(StringView name) const noexcept
+	{
+		if (!count)
+			return nullptr;
+		auto hash = name.getHash();
+		auto mask = slots.size() - 1;
+		for (auto i = static_cast<std::size_t>(hash) & mask;; i = (i + 1) & mask)
+		{
+			auto& slot = slots[i];
+			if (!slot.name.getData())
+				return nullptr;
+			if (slot.hash == hash && slot.name == name)
+				return &slot;
+		}
+	}
+
+	void XMLEntityTable::grow()
+	{
+		std::vector<Entity> old(std::max<std::size_t>(slots.size() * 2, 16));
+		old.swap(slots);
+		count = 0;
+		for (auto& slot : old)
+			if (slot.name.getData())
+				insert(slot.name, slot.value);
+	}
+
+	void XMLEntityTable::relocate(const char* begin, const char* end, Allocator& allocator)
+	{
+		auto move = [&](StringView& view)
+		{
+			if (view.getData() < begin || view.getData() >= end)
+				return;
+			auto data = static_cast<char*>(allocator.allocate(view.getLength() + 1, 1));
+			std::copy(view.begin(), view.end(), data);
+			data[view.getLength()] = 0;
+			view = StringView(data, view.getLength());
+		};
+		for (auto& slot : slots)
+		{
+			if (slot.name.getData())
+			{
+				move(slot.name);
+				move(slot.value);
+			}
+		}
+	}
+
+	void XMLEntityTable::clear() noexcept
+	{
+		std::fill(slots.begin(), slots.end(), Entity());
+		count = 0;
+	}
+
+}
+NS_END
@@ -0,0 +1,59 @@
+﻿#ifndef _ENTITY_HPP
+#define _ENTITY_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+#include <vector>
+
+#include "../Core/compilerdetection.h"
+#include "../Core/allocator.h"
+#include "../Core/string.h"
+
+NS_BEGINE
+inline namespace XML
+{
+
+// Open-addressing table of the general entities declared in a DOCTYPE internal subset.
+// Names and values are views into the parse buffer.
+class AngryParser_API XMLEntityTable
+{
+public:
+    struct Entity
+    {
+        StringView name;
+        StringView value;
+        std::uint64_t hash;
+        bool simple;            // value holds no references and can be copied verbatim
+        mutable bool expanding; // set while the value is being expanded, to catch recursion
+    };
+
+private:
+    std::vector<Entity> slots;
+    std::size_t count;
+
+private:
+    void grow();
+
+public:
+    XMLEntityTable() : slots(), count() {}
+    XMLEntityTable(const XMLEntityTable &src) = delete;
+
+    bool isEmpty() const noexcept { return !count; }
+    std::size_t getSize() const noexcept { return count; }
+
+    // The first declaration of a name is binding; later ones are ignored and return false
+    bool insert(StringView name, StringView value);
+    const Entity *find(StringView name) const noexcept;
+
+    // Copy names and values that point into [begin, end) to allocator, for callers that
+    // are about to reuse that part of the parse buffer
+    void relocate(const char *begin, const char *end, Allocator &allocator);
+
+    void clear() noexcept;
+};
+
+} // namespace XML
+NS_END
+
+#endif
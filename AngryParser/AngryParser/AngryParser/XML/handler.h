@@ -1,8 +1,12 @@
 ﻿#ifndef _HANDLER_HPP
 #define _HANDLER_HPP
 
+#include <type_traits>
+
+#include "../Core/base64.h"
 #include "../Core/compilerdetection.h"
 #include "../Core/string.h"
+#include "namespace.h"
 
 NS_BEGINE
 inline namespace XML
@@ -22,6 +26,62 @@ public:
     void cdata(StringView /*value*/) {}
     void comment(StringView /*value*/) {}
     void processingInstruction(StringView /*name*/, StringView /*value*/) {}
+
+    // Under XMLParser::Flag::Namespaces these replace startElement, endElement and attribute.
+    // startElementNS is called once all attributes of the start tag have been read, followed
+    // by attributeNS for each of them (xmlns declarations included) and then endAttributes.
+    void startElementNS(const XMLQualifiedName & /*name*/) {}
+    void endElementNS(const XMLQualifiedName & /*name*/) {}
+    void attributeNS(const XMLQualifiedName & /*name*/, StringView /*value*/) {}
+
+    // Decode a value passed to attribute, text or cdata as Base64 where it lies and return
+    // the bytes, or a null view if it is not Base64, in which case the value is left partly
+    // overwritten. Values are writable unless the input is parsed with Flag::NonDestructive.
+    static StringView decodeBase64InPlace(StringView value) noexcept
+    {
+        auto data = const_cast<char *>(value.getData());
+        std::size_t size;
+        if (!decodeBase64(value, reinterpret_cast<unsigned char *>(data), size))
+            return StringView();
+        return StringView(data, size);
+    }
+};
+
+namespace Impl
+{
+
+// Whether &H::text and &H::attribute name something other than the members of
+// XMLHandlerBase. Overloads in H make the expression ill-formed and so count as handled.
+template <typename H, typename = void>
+struct HandlesText : std::true_type
+{
+};
+template <typename H>
+struct HandlesText<H, typename std::enable_if<std::is_same<decltype(&H::text), decltype(&XMLHandlerBase::text)>::value>::type> : std::false_type
+{
+};
+template <typename H, typename = void>
+struct HandlesAttribute : std::true_type
+{
+};
+template <typename H>
+struct HandlesAttribute<H, typename std::enable_if<std::is_same<decltype(&H::attribute), decltype(&XMLHandlerBase::attribute)>::value>::type> : std::false_type
+{
+};
+
+} // namespace Impl
+
+// Which callbacks of H do something, so that the parser can skip the work behind the
+// others: text that is not handled is only scanned for its end, without entity
+// translation or whitespace handling, and neither are attribute values unless attribute()
+// is handled or Flag::Namespaces needs them. A callback counts as handled unless H
+// inherits it unchanged from XMLHandlerBase; specialize this to say otherwise. Skipped
+// text and attribute values are not checked for well-formed references.
+template <typename H>
+struct XMLHandlerTraits
+{
+    static constexpr bool text = Impl::HandlesText<H>::value;
+    static constexpr bool attribute = Impl::HandlesAttribute<H>::value;
 };
 
 } // namespace XML
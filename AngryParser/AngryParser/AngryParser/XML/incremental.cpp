@@ -0,0 +1 @@
+﻿#include "incremental.h"
@@ -0,0 +1,353 @@
+﻿#ifndef _INCREMENTAL_HPP
+#define _INCREMENTAL_HPP
+
+#include <cassert>
+#include <cstddef>
+#include <cstring>
+
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "../Core/compilerdetection.h"
+#include "../Core/allocator.h"
+#include "../Core/string.h"
+#include "document.h"
+#include "reader.h"
+
+NS_BEGINE
+inline namespace XML
+{
+
+// DOM that follows byte-range edits of its source text. An edit re-parses only the
+// smallest element whose source encloses it and splices the new subtree in place of the
+// old one. When that text does not parse as exactly one element on its own, the next
+// enclosing element is tried, and finally the whole text.
+//
+// The text is kept as a table of pieces of the buffer passed to parse() and of one
+// buffer per re-parsed element, which are parsed with Flag::NonDestructive and so stay
+// intact. Node offsets are never rewritten: an edit resolves the positions it needs
+// through the piece table, at a cost of one step per piece. Replaced nodes stay in the
+// arena until the next parse(). Namespaces are not resolved, as by XMLReader.
+template <XMLParser::Flag F = XMLParser::Flag::Default>
+class XMLIncrementalDocument
+{
+    static constexpr XMLParser::Flag G = F | XMLParser::Flag::NonDestructive;
+    using Reader = XMLReader<G>;
+    using TokenType = typename Reader::TokenType;
+
+    // Element that knows its source, from the '<' to past the final '>'
+    class Element : public XMLElement
+    {
+    public:
+        Element(StringView name) : XMLElement(name), begin(), end() {}
+
+        const char *begin;
+        const char *end;
+    };
+
+    struct Chunk
+    {
+        std::unique_ptr<char[]> storage; // null for the buffer passed to parse()
+        const char *data;
+        std::size_t length;
+        std::vector<Element *> elements; // in document order, which is address order
+    };
+    struct Piece
+    {
+        const char *data;
+        std::size_t length;
+        std::size_t chunk;
+    };
+
+private:
+    XMLDocument document;
+    Allocator allocator;
+    std::vector<Chunk> chunks;
+    std::vector<Piece> pieces;
+    std::vector<Piece> spliced;
+    std::vector<XMLNode *> path;
+    std::size_t length;
+    bool valid;
+    Reader reader;
+
+private:
+    template <typename T, typename... Args>
+    T &create(Args &&...args)
+    {
+        return *new (allocator.allocate(sizeof(T))) T(std::forward<Args>(args)...);
+    }
+
+    // Build nodes from the reader's tokens, under parent if there is one. Otherwise the
+    // tokens must make up exactly one element spanning the chunk, which is returned, or
+    // nullptr if they do not.
+    Element *build(Chunk &chunk, XMLNode *parent)
+    {
+        XMLNode *cur = parent;
+        Element *root = nullptr;
+        while (reader.next())
+        {
+            switch (reader.tokenType())
+            {
+            case TokenType::StartElement:
+            {
+                auto name = reader.name();
+                if (!cur && (root || name.getData() != chunk.data + 1))
+                    return nullptr;
+                auto &element = create<Element>(name);
+                element.begin = name.getData() - 1;
+                for (auto &attr : reader.attributes())
+                    element.appendAttribute(create<XMLAttribute>(attr.name, attr.value));
+                if (cur)
+                    cur->appendChild(element);
+                else
+                    root = &element;
+                cur = &element;
+                chunk.elements.push_back(&element);
+                break;
+            }
+            case TokenType::EndElement:
+                static_cast<Element *>(cur)->end = chunk.data + reader.getOffset();
+                cur = cur->parent;
+                break;
+            case TokenType::Doctype:
+                if (!cur)
+                    return nullptr;
+                break;
+            default:
+            {
+                if (!cur)
+                    return nullptr;
+                auto name = reader.name();
+                auto value = reader.value();
+                switch (reader.tokenType())
+                {
+                case TokenType::Text:
+                    cur->appendChild(create<XMLText>(value));
+                    break;
+                case TokenType::CDATA:
+                    cur->appendChild(create<XMLCDATA>(value));
+                    break;
+                case TokenType::Comment:
+                    cur->appendChild(create<XMLComment>(value));
+                    break;
+                case TokenType::ProcessingInstruction:
+                    cur->appendChild(create<XMLProcessingInstruction>(name, value));
+                    break;
+                default:
+                    break;
+                }
+                break;
+            }
+            }
+        }
+        if (!parent && (!root || root->end != chunk.data + chunk.length))
+            return nullptr;
+        return root;
+    }
+
+    void load(Chunk &&chunk)
+    {
+        document.clear();
+        allocator.clear();
+        chunks.clear();
+        pieces.clear();
+        valid = false;
+        length = chunk.length;
+        chunks.push_back(std::move(chunk));
+        pieces.push_back({chunks[0].data, length, 0});
+        auto data = const_cast<char *>(chunks[0].data);
+        reader.resume(data);
+        reader.start(data);
+        build(chunks[0], &document);
+        valid = true;
+    }
+
+    // Offset in the text of ptr, which must be a byte of some piece
+    std::size_t position(const char *ptr) const noexcept
+    {
+        std::size_t offset = 0;
+        for (auto &piece : pieces)
+        {
+            if (ptr >= piece.data && ptr < piece.data + piece.length)
+                return offset + (ptr - piece.data);
+            offset += piece.length;
+        }
+        assert(false);
+        return offset;
+    }
+
+    // Copy the text in [begin, end) to out and return the end of the copy
+    char *copyText(std::size_t begin, std::size_t end, char *out) const noexcept
+    {
+        std::size_t offset = 0;
+        for (auto &piece : pieces)
+        {
+            if (offset >= end)
+                break;
+            auto from = std::max(begin, offset);
+            auto to = std::min(end, offset + piece.length);
+            if (from < to)
+            {
+                std::memcpy(out, piece.data + (from - offset), to - from);
+                out += to - from;
+            }
+            offset += piece.length;
+        }
+        return out;
+    }
+
+    // Replace the text in [begin, end) with the whole of chunk
+    void splice(std::size_t begin, std::size_t end, std::size_t chunk)
+    {
+        spliced.clear();
+        std::size_t offset = 0;
+        bool inserted = false;
+        for (auto &piece : pieces)
+        {
+            auto next = offset + piece.length;
+            if (next <= begin)
+                spliced.push_back(piece);
+            else
+            {
+                if (offset < begin)
+                    spliced.push_back({piece.data, begin - offset, piece.chunk});
+                if (!inserted)
+                {
+                    spliced.push_back({chunks[chunk].data, chunks[chunk].length, chunk});
+                    inserted = true;
+                }
+                if (next > end)
+                {
+                    auto from = std::max(offset, end);
+                    spliced.push_back({piece.data + (from - offset), next - from, piece.chunk});
+                }
+            }
+            offset = next;
+        }
+        pieces.swap(spliced);
+    }
+
+    static bool isLinked(const XMLNode &node) noexcept
+    {
+        if (node.prev)
+            return node.prev->next == &node;
+        return node.parent->hasChildNodes() && &node.parent->getFirstChild() == &node;
+    }
+
+    // New chunk holding the text in [begin, end) with the edit applied
+    Chunk makeChunk(std::size_t begin, std::size_t end, std::size_t offset, std::size_t removed, StringView inserted) const
+    {
+        auto size = end - begin - removed + inserted.getLength();
+        Chunk chunk{std::unique_ptr<char[]>(new char[size + 1]), nullptr, size, std::vector<Element *>()};
+        chunk.data = chunk.storage.get();
+        auto out = copyText(begin, offset, chunk.storage.get());
+        if (inserted.getLength())
+            std::memcpy(out, inserted.getData(), inserted.getLength());
+        out = copyText(offset + removed, end, out + inserted.getLength());
+        *out = 0;
+        return chunk;
+    }
+
+    // Re-parse element, whose text is [begin, end), with the edit applied. Returns the
+    // new element, or nullptr if the text is not exactly one element.
+    Element *reparse(Element &element, std::size_t begin, std::size_t end, std::size_t offset, std::size_t removed, StringView inserted)
+    {
+        chunks.push_back(makeChunk(begin, end, offset, removed, inserted));
+        auto &chunk = chunks.back();
+        Element *root = nullptr;
+        try
+        {
+            reader.resume(chunk.storage.get());
+            root = build(chunk, nullptr);
+        }
+        catch (const XMLParseException &)
+        {
+        }
+        if (!root)
+        {
+            chunks.pop_back();
+            return nullptr;
+        }
+        element.parent->replaceChild(*root, element);
+        splice(begin, end, chunks.size() - 1);
+        length += inserted.getLength() - removed;
+        return root;
+    }
+
+public:
+    XMLIncrementalDocument() : document(), allocator(), chunks(), pieces(), spliced(), path(), length(), valid(), reader("", allocator) {}
+    XMLIncrementalDocument(const XMLIncrementalDocument &src) = delete;
+
+    XMLIncrementalDocument &operator=(const XMLIncrementalDocument &src) = delete;
+
+    // Parse data, which must stay alive and unchanged for as long as the document is used
+    void parse(const char *data)
+    {
+        assert(data);
+
+        load({nullptr, data, std::strlen(data), std::vector<Element *>()});
+    }
+
+    // Replace removed bytes at offset with inserted and bring the DOM up to date. Returns
+    // the node that was rebuilt, the re-parsed element or the document itself. A parse
+    // error in the whole text throws; the edit is kept and the next one parses it again.
+    const XMLNode &edit(std::size_t offset, std::size_t removed, StringView inserted)
+    {
+        if (offset > length || removed > length - offset)
+            throw XMLDOMException("Edit out of range");
+        if (valid && offset < length)
+        {
+            // Last element of the chunk starting at or before the edited byte
+            std::size_t base = 0;
+            auto piece = pieces.begin();
+            while (base + piece->length <= offset)
+                base += (piece++)->length;
+            auto pos = piece->data + (offset - base);
+            auto &elements = chunks[piece->chunk].elements;
+            auto it = std::upper_bound(elements.begin(), elements.end(), pos, [](const char *p, const Element *e) { return p < e->begin; });
+            if (it != elements.begin())
+            {
+                // Its ancestors up to the first that was replaced by an earlier edit are
+                // gone; the smallest enclosing element is among the others.
+                path.clear();
+                for (XMLNode *node = *(it - 1); node != &document; node = node->parent)
+                    path.push_back(node);
+                auto live = path.size();
+                while (live && isLinked(*path[live - 1]))
+                    --live;
+                for (auto i = live; i < path.size(); ++i)
+                {
+                    auto &element = *static_cast<Element *>(path[i]);
+                    auto begin = position(element.begin);
+                    auto end = position(element.end - 1) + 1;
+                    if (begin <= offset && offset + removed <= end)
+                    {
+                        if (auto root = reparse(element, begin, end, offset, removed, inserted))
+                            return *root;
+                    }
+                }
+            }
+        }
+        load(makeChunk(0, length, offset, removed, inserted));
+        return document;
+    }
+
+    const XMLDocument &getDocument() const noexcept { return document; }
+
+    std::size_t getLength() const noexcept { return length; }
+
+    std::string getText() const
+    {
+        std::string text(length, '\0');
+        copyText(0, length, &text[0]);
+        return text;
+    }
+};
+
+} // namespace XML
+NS_END
+
+#endif
@@ -0,0 +1,396 @@
+﻿#include "loader.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstring>
+#include <mutex>
+
+#include "../Core/exception.h"
+
+#if defined(__linux__) && !defined(ANGRYPARSER_NO_IO_URING) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define ANGRYPARSER_IO_URING
+#endif
+#endif
+
+#if defined(ANGRYPARSER_IO_URING)
+#include <cerrno>
+#include <cstdint>
+
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
+NS_BEGINE
+inline namespace XML
+{
+#if defined(ANGRYPARSER_IO_URING)
+	// Submission and completion queues shared with the kernel, driven by raw system calls
+	struct XMLFileLoader::Ring
+	{
+		int fd;
+		void* sq;
+		std::size_t sqSize;
+		void* cq;
+		std::size_t cqSize;
+		io_uring_sqe* sqes;
+		std::size_t sqesSize;
+		unsigned* sqHead;
+		unsigned* sqTail;
+		unsigned* sqMask;
+		unsigned* sqArray;
+		unsigned* cqHead;
+		unsigned* cqTail;
+		unsigned* cqMask;
+		io_uring_cqe* cqes;
+		unsigned tail;
+		unsigned pending; // queued but not yet taken by the kernel
+		bool fixed;       // the loader's buffers are registered
+
+		explicit Ring(unsigned entries) : fd(-1), sq(MAP_FAILED), sqSize(), cq(MAP_FAILED), cqSize(), sqes(static_cast<io_uring_sqe*>(MAP_FAILED)), sqesSize(), sqHead(), sqTail(), sqMask(), sqArray(), cqHead(), cqTail(), cqMask(), cqes(), tail(), pending(), fixed()
+		{
+			io_uring_params params;
+			std::memset(&params, 0, sizeof(params));
+			fd = static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+			if (fd < 0)
+				throw SystemException("io_uring_setup failed");
+			sqSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+			cqSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+			bool single = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+			if (single)
+				sqSize = cqSize = std::max(sqSize, cqSize);
+			sq = mmap(nullptr, sqSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+			if (sq == MAP_FAILED)
+				fail();
+			cq = single ? sq : mmap(nullptr, cqSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+			if (cq == MAP_FAILED)
+				fail();
+			sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+			sqes = static_cast<io_uring_sqe*>(mmap(nullptr, sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES));
+			if (sqes == MAP_FAILED)
+				fail();
+			auto sqBase = static_cast<char*>(sq);
+			auto cqBase = static_cast<char*>(cq);
+			sqHead = reinterpret_cast<unsigned*>(sqBase + params.sq_off.head);
+			sqTail = reinterpret_cast<unsigned*>(sqBase + params.sq_off.tail);
+			sqMask = reinterpret_cast<unsigned*>(sqBase + params.sq_off.ring_mask);
+			sqArray = reinterpret_cast<unsigned*>(sqBase + params.sq_off.array);
+			cqHead = reinterpret_cast<unsigned*>(cqBase + params.cq_off.head);
+			cqTail = reinterpret_cast<unsigned*>(cqBase + params.cq_off.tail);
+			cqMask = reinterpret_cast<unsigned*>(cqBase + params.cq_off.ring_mask);
+			cqes = reinterpret_cast<io_uring_cqe*>(cqBase + params.cq_off.cqes);
+			tail = *sqTail;
+		}
+		Ring(const Ring& src) = delete;
+		~Ring() { release(); }
+
+		Ring& operator=(const Ring& src) = delete;
+
+		void release() noexcept
+		{
+			if (sqes != MAP_FAILED)
+				munmap(sqes, sqesSize);
+			if (cq != MAP_FAILED && cq != sq)
+				munmap(cq, cqSize);
+			if (sq != MAP_FAILED)
+				munmap(sq, sqSize);
+			if (fd >= 0)
+				close(fd);
+		}
+		[[noreturn]] void fail()
+		{
+			release();
+			throw SystemException("io_uring mmap failed");
+		}
+
+		bool registerBuffers(const iovec* iov, unsigned n) noexcept
+		{
+			fixed = syscall(__NR_io_uring_register, fd, IORING_REGISTER_BUFFERS, iov, n) == 0;
+			return fixed;
+		}
+
+		// The caller keeps no more entries in flight than the ring holds
+		io_uring_sqe& next() noexcept
+		{
+			auto index = tail & *sqMask;
+			sqArray[index] = index;
+			++tail;
+			++pending;
+			auto& sqe = sqes[index];
+			std::memset(&sqe, 0, sizeof(sqe));
+			return sqe;
+		}
+
+		// Submit what is queued and wait for at least wait completions
+		void enter(unsigned wait)
+		{
+			__atomic_store_n(sqTail, tail, __ATOMIC_RELEASE);
+			while (true)
+			{
+				auto n = syscall(__NR_io_uring_enter, fd, pending, wait, wait ? IORING_ENTER_GETEVENTS : 0, nullptr, 0);
+				if (n >= 0)
+				{
+					pending -= static_cast<unsigned>(n);
+					return;
+				}
+				if (errno != EINTR)
+					throw SystemException("io_uring_enter failed");
+			}
+		}
+
+		bool reap(io_uring_cqe& cqe) noexcept
+		{
+			auto head = *cqHead;
+			if (head == __atomic_load_n(cqTail, __ATOMIC_ACQUIRE))
+				return false;
+			cqe = cqes[head & *cqMask];
+			__atomic_store_n(cqHead, head + 1, __ATOMIC_RELEASE);
+			return true;
+		}
+	};
+
+	namespace
+	{
+		struct Slot
+		{
+			char* buffer; // registered, bufferSize bytes
+			std::vector<char> overflow;
+			iovec iov;
+			int fd;
+			std::size_t index;
+			char* data;
+			std::size_t size;
+			std::size_t done;
+		};
+	}
+
+	// Read buffers, handed back by the workers once their file is parsed
+	struct XMLFileLoader::Reads
+	{
+		std::vector<Slot> slots;
+		std::vector<std::size_t> slotOf; // slot holding each submitted file
+		std::vector<std::size_t> free;
+		std::mutex mutex;
+		std::condition_variable freeChanged;
+	};
+#else
+	struct XMLFileLoader::Ring
+	{
+	};
+
+	struct XMLFileLoader::Reads
+	{
+	};
+#endif
+
+	XMLFileLoader::XMLFileLoader(std::size_t threads_, std::size_t depth_, std::size_t bufferSize_) : depth(std::max<std::size_t>(depth_, 1)), bufferSize(std::max<std::size_t>(bufferSize_, 1)), ownPool(new XMLBatchParser(threads_)), pool(ownPool.get()), buffers(), ring(), reads()
+	{
+		openRing();
+	}
+
+	XMLFileLoader::XMLFileLoader(XMLBatchParser& pool_, std::size_t depth_, std::size_t bufferSize_) : depth(std::max<std::size_t>(depth_, 1)), bufferSize(std::max<std::size_t>(bufferSize_, 1)), ownPool(), pool(&pool_), buffers(), ring(), reads()
+	{
+		openRing();
+	}
+
+	XMLFileLoader::~XMLFileLoader() = default;
+
+#if defined(ANGRYPARSER_IO_URING)
+	void XMLFileLoader::openRing()
+	{
+		try
+		{
+			ring.reset(new Ring(static_cast<unsigned>(depth)));
+		}
+		catch (const SystemException&)
+		{
+			return;
+		}
+		buffers.resize(depth * bufferSize);
+		reads.reset(new Reads());
+		reads->slots.resize(depth);
+		std::vector<iovec> iov(depth);
+		for (std::size_t i = 0; i < depth; ++i)
+		{
+			reads->slots[i].buffer = buffers.data() + i * bufferSize;
+			reads->slots[i].fd = -1;
+			iov[i] = {buffers.data() + i * bufferSize, bufferSize};
+		}
+		// Without registration (RLIMIT_MEMLOCK) the same buffers are read into with readv
+		ring->registerBuffers(iov.data(), static_cast<unsigned>(depth));
+	}
+
+	void XMLFileLoader::release(std::size_t index)
+	{
+		{
+			std::lock_guard<std::mutex> lock(reads->mutex);
+			reads->free.push_back(reads->slotOf[index]);
+		}
+		reads->freeChanged.notify_one();
+	}
+
+	// Parsing happens on the workers, this thread only reads
+	void XMLFileLoader::read(const std::vector<std::string>& paths, const XMLBatchParser::Submit& submitParse)
+	{
+		auto& slots = reads->slots;
+		auto& free = reads->free;
+		std::vector<std::size_t> taken;
+		free.clear();
+		for (std::size_t i = 0; i < depth; ++i)
+			free.push_back(depth - 1 - i);
+		reads->slotOf.assign(paths.size(), 0);
+
+		std::size_t next = 0, inflight = 0;
+		auto complete = [&](std::size_t id, bool readable)
+		{
+			auto& slot = slots[id];
+			if (slot.fd >= 0)
+			{
+				close(slot.fd);
+				slot.fd = -1;
+			}
+			if (readable)
+				slot.data[slot.size] = 0;
+			submitParse(slot.index, readable ? slot.data : nullptr);
+		};
+		auto submit = [&](std::size_t id)
+		{
+			auto& slot = slots[id];
+			auto& sqe = ring->next();
+			auto length = static_cast<unsigned>(std::min<std::size_t>(slot.size - slot.done, std::size_t(1) << 30));
+			if (ring->fixed && slot.data == slot.buffer)
+			{
+				sqe.opcode = IORING_OP_READ_FIXED;
+				sqe.addr = reinterpret_cast<std::uintptr_t>(slot.data + slot.done);
+				sqe.len = length;
+				sqe.buf_index = static_cast<std::uint16_t>(id);
+			}
+			else
+			{
+				slot.iov = {slot.data + slot.done, length};
+				sqe.opcode = IORING_OP_READV;
+				sqe.addr = reinterpret_cast<std::uintptr_t>(&slot.iov);
+				sqe.len = 1;
+			}
+			sqe.fd = slot.fd;
+			sqe.off = slot.done;
+			sqe.user_data = id;
+			++inflight;
+		};
+		auto reap = [&]
+		{
+			io_uring_cqe cqe;
+			while (ring->reap(cqe))
+			{
+				--inflight;
+				auto id = static_cast<std::size_t>(cqe.user_data);
+				auto& slot = slots[id];
+				if (cqe.res <= 0)
+					complete(id, false);
+				else if ((slot.done += cqe.res) < slot.size)
+					submit(id);
+				else
+					complete(id, true);
+			}
+		};
+
+		try
+		{
+			while (true)
+			{
+				{
+					std::unique_lock<std::mutex> lock(reads->mutex);
+					if (next < paths.size() && free.empty() && !inflight)
+						reads->freeChanged.wait(lock, [&] { return !free.empty(); });
+					while (!free.empty() && taken.size() < paths.size() - next)
+					{
+						taken.push_back(free.back());
+						free.pop_back();
+					}
+				}
+				for (auto id : taken)
+				{
+					auto& slot = slots[id];
+					slot.index = next++;
+					reads->slotOf[slot.index] = id;
+					slot.done = 0;
+					slot.size = 0;
+					slot.fd = open(paths[slot.index].c_str(), O_RDONLY | O_CLOEXEC);
+					struct stat st;
+					if (slot.fd < 0 || fstat(slot.fd, &st) != 0)
+					{
+						complete(id, false);
+						continue;
+					}
+					slot.size = static_cast<std::size_t>(st.st_size);
+					if (slot.size < bufferSize)
+						slot.data = slot.buffer;
+					else
+					{
+						slot.overflow.resize(slot.size + 1);
+						slot.data = slot.overflow.data();
+					}
+					if (slot.size)
+						submit(id);
+					else
+						complete(id, true);
+				}
+				taken.clear();
+				if (!inflight)
+				{
+					if (next == paths.size())
+						break;
+					continue;
+				}
+				ring->enter(1);
+				reap();
+			}
+		}
+		catch (...)
+		{
+			// The kernel may still write to the buffers until every read is reaped
+			try
+			{
+				while (inflight)
+				{
+					ring->enter(1);
+					io_uring_cqe cqe;
+					while (ring->reap(cqe))
+						--inflight;
+				}
+			}
+			catch (const SystemException&)
+			{
+			}
+			for (auto& slot : slots)
+			{
+				if (slot.fd >= 0)
+				{
+					close(slot.fd);
+					slot.fd = -1;
+				}
+			}
+			throw;
+		}
+	}
+#else
+	void XMLFileLoader::openRing()
+	{
+	}
+
+	void XMLFileLoader::read(const std::vector<std::string>&, const XMLBatchParser::Submit&)
+	{
+	}
+
+	void XMLFileLoader::release(std::size_t)
+	{
+	}
+#endif
+
+}
+NS_END
@@ -0,0 +1,80 @@
+﻿#ifndef _LOADER_HPP
+#define _LOADER_HPP
+
+#include <cstddef>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "../Core/compilerdetection.h"
+
+#include "batch.h"
+
+NS_BEGINE
+inline namespace XML
+{
+
+// Reads many files with up to depth reads in flight and hands each to the workers of an
+// XMLBatchParser as soon as its read completes, so that reading and parsing overlap. On
+// Linux the reads go through io_uring, driven by the calling thread, into depth buffers
+// of bufferSize bytes registered with the kernel; a larger file gets a buffer of its own.
+// Where io_uring is not available (other systems, kernels without it, or
+// ANGRYPARSER_NO_IO_URING defined) the fallback is XMLBatchParser::parseFiles, whose
+// workers each pread their next file into their own buffer before parsing it.
+//
+// The pool is the loader's own or one shared with other users; batches on a shared pool
+// must not overlap. An exception thrown by a callback stops nothing, but is rethrown once
+// all files are done.
+class AngryParser_API XMLFileLoader
+{
+public:
+    using Result = XMLBatchParser::Result;
+
+private:
+    struct Ring;
+    struct Reads;
+
+private:
+    std::size_t depth;
+    std::size_t bufferSize;
+    std::unique_ptr<XMLBatchParser> ownPool;
+    XMLBatchParser *pool;
+    std::vector<char> buffers;
+    std::unique_ptr<Ring> ring;
+    std::unique_ptr<Reads> reads;
+
+private:
+    void openRing();
+    void read(const std::vector<std::string> &paths, const XMLBatchParser::Submit &submit);
+    void release(std::size_t index);
+
+public:
+    // threads_ == 0 uses one worker per hardware thread
+    explicit XMLFileLoader(std::size_t threads_ = 0, std::size_t depth_ = 32, std::size_t bufferSize_ = std::size_t(1) << 18);
+    explicit XMLFileLoader(XMLBatchParser &pool_, std::size_t depth_ = 32, std::size_t bufferSize_ = std::size_t(1) << 18);
+    XMLFileLoader(const XMLFileLoader &src) = delete;
+    ~XMLFileLoader();
+
+    XMLFileLoader &operator=(const XMLFileLoader &src) = delete;
+
+    std::size_t getThreadCount() const noexcept { return pool->getThreadCount(); }
+    bool usesRing() const noexcept { return ring != nullptr; }
+
+    // callback(const Result &) runs on a worker as each file is parsed, in no particular
+    // order and concurrently with other callbacks. The document is reused once it returns.
+    template <XMLParser::Flag F = XMLParser::Flag::Default, typename C>
+    void parseFiles(const std::vector<std::string> &paths, C &&callback)
+    {
+        if (!ring)
+            return pool->parseFiles<F>(paths, callback);
+        pool->parseSubmitted<F>(
+            paths.size(), [&](const XMLBatchParser::Submit &submit) { read(paths, submit); }, callback,
+            [&](std::size_t index) { release(index); });
+    }
+};
+
+} // namespace XML
+NS_END
+
+#endif
@@ -0,0 +1,91 @@
+﻿#include "namespace.h"
+
+#include <algorithm>
+
+#include "../Core/hash.h"
+
+NS_BEGINE
+inline namespace XML
+{
+	namespace
+	{
+		const StringView predefined[] = {
+			StringView(),
+			"http://www.w3.org/XML/1998/namespace",
+			"http://www.w3.org/2000/xmlns/",
+		};
+	}
+
+	XMLNamespaceTable::XMLNamespaceTable() : slots(), uris(), storage()
+	{
+	}
+
+	XMLNamespace XMLNamespaceTable::intern(StringView uri)
+	{
+		XMLNamespace id;
+		if (find(uri, id))
+			return id;
+		if ((uris.size() + 1) * 2 > slots.size())
+			grow();
+		auto data = static_cast<char*>(storage.allocate(uri.getLength(), 1));
+		std::copy(uri.begin(), uri.end(), data);
+		StringView copy(data, uri.getLength());
+		id = static_cast<XMLNamespace>(Predefined + uris.size());
+		uris.push_back(copy);
+		insert(copy, copy.getHash(), id);
+		return id;
+	}
+
+	bool XMLNamespaceTable::find(StringView uri, XMLNamespace& id) const noexcept
+	{
+		for (std::size_t i = 0; i < Predefined; ++i)
+		{
+			if (uri == predefined[i])
+			{
+				id = static_cast<XMLNamespace>(i);
+				return true;
+			}
+		}
+		if (slots.empty())
+			return false;
+		auto hash = uri.getHash();
+		auto mask = slots.size() - 1;
+		for (auto i = static_cast<std::size_t>(hash) & mask;; i = (i + 1) & mask)
+		{
+			auto& slot = slots[i];
+			if (!slot.uri.getData())
+				return false;
+			if (slot.hash == hash && slot.uri == uri)
+			{
+				id = slot.id;
+				return true;
+			}
+		}
+	}
+
+	StringView XMLNamespaceTable::getURI(XMLNamespace id) const noexcept
+	{
+		auto i = static_cast<std::size_t>(id);
+		return i < Predefined ? predefined[i] : uris[i - Predefined];
+	}
+
+	void XMLNamespaceTable::insert(StringView uri, std::uint64_t hash, XMLNamespace id)
+	{
+		auto mask = slots.size() - 1;
+		auto i = static_cast<std::size_t>(hash) & mask;
+		while (slots[i].uri.getData())
+			i = (i + 1) & mask;
+		slots[i] = { uri, hash, id };
+	}
+
+	void XMLNamespaceTable::grow()
+	{
+		std::vector<Slot> old(std::max<std::size_t>(slots.size() * 2, 16));
+		old.swap(slots);
+		for (auto& slot : old)
+			if (slot.uri.getData())
+				insert(slot.uri, slot.hash, slot.id);
+	}
+
+}
+NS_END
@@ -0,0 +1,82 @@
+﻿#ifndef _NAMESPACE_HPP
+#define _NAMESPACE_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+#include <vector>
+
+#include "../Core/compilerdetection.h"
+#include "../Core/allocator.h"
+#include "../Core/string.h"
+
+NS_BEGINE
+inline namespace XML
+{
+
+// Interned namespace URI. Two names are in the same namespace exactly when their
+// XMLNamespace values are equal, provided both come from the same XMLNamespaceTable.
+enum class XMLNamespace : std::uint32_t
+{
+    None = 0,  // no namespace, or xmlns=""
+    XML = 1,   // http://www.w3.org/XML/1998/namespace, bound to the prefix "xml"
+    XMLNS = 2, // http://www.w3.org/2000/xmlns/, the namespace of xmlns attributes
+};
+
+// Name reported under XMLParser::Flag::Namespaces
+struct XMLQualifiedName
+{
+    StringView name;      // as written, "prefix:local" or "local"
+    StringView localName; // the part of name after the colon
+    XMLNamespace uri;
+
+    StringView getPrefix() const noexcept
+    {
+        auto length = name.getLength() - localName.getLength();
+        return StringView(name.getData(), length ? length - 1 : 0);
+    }
+    bool matches(XMLNamespace uri_, StringView localName_) const noexcept { return uri == uri_ && localName == localName_; }
+};
+
+// Maps namespace URIs to small integers. URIs are copied into storage owned by the
+// table, so ids stay valid after the parsed buffer is gone.
+class AngryParser_API XMLNamespaceTable
+{
+private:
+    struct Slot
+    {
+        StringView uri;
+        std::uint64_t hash;
+        XMLNamespace id;
+    };
+
+    static constexpr std::size_t Predefined = 3;
+
+private:
+    // Nothing is allocated until the first URI other than the predefined ones is interned
+    std::vector<Slot> slots;
+    std::vector<StringView> uris;
+    Allocator storage;
+
+private:
+    void grow();
+    void insert(StringView uri, std::uint64_t hash, XMLNamespace id);
+
+public:
+    XMLNamespaceTable();
+    XMLNamespaceTable(const XMLNamespaceTable &src) = delete;
+
+    // Return the id of uri, assigning the next one if it has not been seen. The empty URI is None.
+    XMLNamespace intern(StringView uri);
+    // Look up uri without interning it; returns false if it has never been interned
+    bool find(StringView uri, XMLNamespace &id) const noexcept;
+
+    StringView getURI(XMLNamespace id) const noexcept;
+    // Number of ids in use, None, XML and XMLNS included
+    std::size_t getSize() const noexcept { return Predefined + uris.size(); }
+};
+
+} // namespace XML
+NS_END
+
+#endif
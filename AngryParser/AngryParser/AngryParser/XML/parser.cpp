@@ -1 +1,72 @@
-﻿#include "parser.h"
\ No newline at end of file
+﻿#include "parser.h"
+
+NS_BEGINE
+inline namespace XML
+{
+	namespace
+	{
+		// Indexed by XMLParseError; the prefix lets what() share the same static strings
+		const char* const messages[] = {
+			"XMLParseException: No error",
+			"XMLParseException: Unexpected end of data",
+			"XMLParseException: Unexpected character",
+			"XMLParseException: Unexpected ;",
+			"XMLParseException: Expected ;",
+			"XMLParseException: Invalid reference",
+			"XMLParseException: Expected version",
+			"XMLParseException: Expected =",
+			"XMLParseException: Expected \"",
+			"XMLParseException: Expected '",
+			"XMLParseException: Expected \" or '",
+			"XMLParseException: Expected ?>",
+			"XMLParseException: Expected PI target",
+			"XMLParseException: Expected white space",
+			"XMLParseException: Expected element type",
+			"XMLParseException: Expected >",
+			"XMLParseException: Expected attribute name",
+			"XMLParseException: Expected <",
+			"XMLParseException: Unmatched element type",
+			"XMLParseException: Not implemented",
+			"XMLParseException: Recursive entity reference",
+			"XMLParseException: Entity nesting too deep",
+			"XMLParseException: Entity expansion limit exceeded",
+			"XMLParseException: Markup in entity value",
+			"XMLParseException: Unbound namespace prefix",
+			"XMLParseException: Invalid namespace declaration",
+			"XMLParseException: Elements nested too deep",
+			"XMLParseException: Element limit exceeded",
+			"XMLParseException: Attribute limit exceeded",
+			"XMLParseException: Memory limit exceeded",
+			"XMLParseException: Out of memory",
+		};
+		const std::size_t prefixLength = sizeof("XMLParseException: ") - 1;
+
+		const char* getDescription(XMLParseError error) noexcept
+		{
+			auto index = static_cast<std::size_t>(error);
+			return index < sizeof(messages) / sizeof(*messages) ? messages[index] : "XMLParseException: Unknown error";
+		}
+	}
+
+	const char* getErrorMessage(XMLParseError error) noexcept
+	{
+		return getDescription(error) + prefixLength;
+	}
+
+	XMLParseLocation XMLParseResult::getLocation(const char* data) const noexcept
+	{
+		XMLParseLocation location = { 1, 1 };
+		auto lineStart = data;
+		for (auto q = data, end = data + offset; q != end; ++q)
+			if (*q == '\n')
+				++location.line, lineStart = q + 1;
+		location.column = data + offset - lineStart + 1;
+		return location;
+	}
+
+	XMLParseException::XMLParseException(XMLParseError error_, std::size_t pos_) noexcept : Exception(StaticMessage(), getDescription(error_)), error(error_), pos(pos_)
+	{
+	}
+
+}
+NS_END
\ No newline at end of file
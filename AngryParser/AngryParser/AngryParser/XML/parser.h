@@ -3,14 +3,25 @@
 
 #include <cassert>
 #include <cstdint>
+#include <cstring>
 
 #include <algorithm>
+#include <chrono>
 #include <exception>
 #include <limits>
+#include <memory>
+#include <new>
+#include <string>
+#include <vector>
 
 #include "../Core/exception.h"
 #include "../Core/compilerdetection.h"
 
+#include "../Core/allocator.h"
+#include "entity.h"
+#include "handler.h"
+#include "namespace.h"
+
 NS_BEGINE
 inline namespace XML
 {
@@ -84,7 +95,7 @@ static bool isCharType(char *&p, SkipCharType sct)
     break;
     case SkipCharType::AttributeValue2:
     {
-        if (*t && *t == '\"')
+        if (*t && *t == '\'')
         {
             return true;
         }
@@ -92,7 +103,7 @@ static bool isCharType(char *&p, SkipCharType sct)
     break;
     case SkipCharType::AttributeValueNoRef2:
     {
-        if (*t && (*t == '&' || *t == '\"'))
+        if (*t && (*t == '&' || *t == '\''))
         {
             return true;
         }
@@ -158,7 +169,7 @@ static size_t skipChar(char *&p, SkipCharType sct = SkipCharType::Space)
     break;
     case SkipCharType::Name:
     {
-        while ((*t != '\t') && (*t != '\n') && (*t != '\r') && (*t != ' ') && (*t != '/') && (*t != '>') && (*t != '?'))
+        while (*t && (*t != '\t') && (*t != '\n') && (*t != '\r') && (*t != ' ') && (*t != '/') && (*t != '>') && (*t != '?'))
         {
             ++t;
         }
@@ -202,7 +213,7 @@ static size_t skipChar(char *&p, SkipCharType sct = SkipCharType::Space)
     break;
     case SkipCharType::AttributeValue2:
     {
-        while (*t && *t != '\"')
+        while (*t && *t != '\'')
         {
             ++t;
         }
@@ -213,7 +224,7 @@ static size_t skipChar(char *&p, SkipCharType sct = SkipCharType::Space)
     break;
     case SkipCharType::AttributeValueNoRef2:
     {
-        while (*t && (*t != '&' && *t != '\"'))
+        while (*t && (*t != '&' && *t != '\''))
         {
             ++t;
         }
@@ -288,14 +299,79 @@ constexpr unsigned char toHexadecimalChar(unsigned char t)
 
 } // namespace Impl
 
-class XMLParseException : public Exception
+enum class XMLParseError : std::uint32_t
+{
+    None,
+    UnexpectedEndOfData,
+    UnexpectedCharacter,
+    UnexpectedSemicolon,
+    ExpectedSemicolon,
+    InvalidReference,
+    ExpectedVersion,
+    ExpectedEquals,
+    ExpectedQuotationMark,
+    ExpectedApostrophe,
+    ExpectedQuote,
+    ExpectedDeclarationEnd,
+    ExpectedPITarget,
+    ExpectedWhiteSpace,
+    ExpectedElementType,
+    ExpectedGreaterThan,
+    ExpectedAttributeName,
+    ExpectedLessThan,
+    UnmatchedElementType,
+    NotImplemented,
+    RecursiveEntity,
+    EntityDepthExceeded,
+    EntityExpansionExceeded,
+    InvalidEntityValue,
+    UnboundPrefix,
+    InvalidNamespaceDeclaration,
+    DepthLimitExceeded,
+    ElementLimitExceeded,
+    AttributeLimitExceeded,
+    MemoryLimitExceeded,
+    OutOfMemory,
+};
+
+AngryParser_API const char *getErrorMessage(XMLParseError error) noexcept;
+
+struct XMLParseLocation
+{
+    std::size_t line;
+    std::size_t column;
+};
+
+struct AngryParser_API XMLParseResult
+{
+    XMLParseError error;
+    std::size_t offset;
+
+    explicit operator bool() const noexcept { return error == XMLParseError::None; }
+
+    const char *getMessage() const noexcept { return getErrorMessage(error); }
+
+    // 1-based line and column of offset, found by scanning data up to it. The parser
+    // rewrites decoded text in situ, so after an EntityTranslation or NormalizeSpace
+    // parse lines inside earlier rewritten text may be counted more than once, unless
+    // the parse was NonDestructive.
+    XMLParseLocation getLocation(const char *data) const noexcept;
+};
+
+// Carries only the error code and offset; what() points at a static message, so
+// constructing and throwing one never allocates beyond the exception object itself.
+class AngryParser_API XMLParseException : public Exception
 {
 
 private:
+    XMLParseError error;
     std::size_t pos;
 
 public:
-    XMLParseException(const StringView&data, std::size_t pos_) : Exception("XMLParseException: " + data), pos(pos_) {}
+    XMLParseException(XMLParseError error_, std::size_t pos_) noexcept;
+
+    XMLParseError getError() const noexcept { return error; }
+    std::size_t getOffset() const noexcept { return pos; }
 };
 
 class AngryParser_API XMLParser
@@ -310,6 +386,9 @@ public:
         NormalizeSpace = 0x00000002,
         EntityTranslation = 0x00000004,
         ClosingTagValidate = 0x00000008,
+        Statistics = 0x00000010,
+        Namespaces = 0x00000020,
+        NonDestructive = 0x00000040,
 
         Default = TrimSpace | EntityTranslation,
 
@@ -325,20 +404,158 @@ public:
         return static_cast<Flag>(static_cast<std::uint32_t>(a) | static_cast<std::uint32_t>(b));
     }
 
+    // XMLReader drives the same scanning routines one token at a time
+    template <Flag>
+    friend class XMLReader;
+    template <Flag>
+    friend class XMLStreamReader;
+
+    // Bounds on general entity expansion. The expanded bytes of a document may not exceed
+    // entityExpansion + entityAmplification * (bytes parsed), which keeps entity-heavy
+    // input linear in its size. depth, elements and attributes bound the nesting of
+    // elements and their numbers in a document, and are unlimited by default.
+    struct Limits
+    {
+        std::size_t entityDepth = 32;
+        std::size_t entityExpansion = std::size_t(1) << 20;
+        std::size_t entityAmplification = 8;
+        std::size_t depth = std::numeric_limits<std::size_t>::max();
+        std::size_t elements = std::numeric_limits<std::size_t>::max();
+        std::size_t attributes = std::numeric_limits<std::size_t>::max();
+    };
+
+    // Filled in when parsing with Flag::Statistics; without it none of the counters or
+    // timers are compiled in. Body time includes callback time.
+    struct Statistics
+    {
+        std::size_t bytes;
+        std::size_t elements;
+        std::size_t attributes;
+        std::size_t texts;
+        std::size_t references;
+        std::size_t maxDepth;
+        std::chrono::nanoseconds declarationTime;
+        std::chrono::nanoseconds bodyTime;
+        std::chrono::nanoseconds callbackTime;
+    };
+
 private:
+    // Set by tryParse; every failure then records the error and unwinds by returning
+    static constexpr Flag NoThrow = static_cast<Flag>(0x80000000);
+
     char *s;
     char *p;
+    std::size_t depth;
+    std::size_t elementCount;
+    std::size_t attributeCount;
+    Statistics statistics;
+    XMLParseError error;
+    std::size_t errorOffset;
+    Limits limits;
+    XMLEntityTable entities;
+    std::size_t expanded;
+    char *reference; // the '&' in the document while p is inside replacement text
+    std::string scratch;
+    Allocator storage;
+    Allocator *allocator;
+
+    // Namespace scope: in-scope bindings, innermost last. Each element truncates the
+    // stack back to its own mark when it ends.
+    struct Binding
+    {
+        StringView prefix;
+        XMLNamespace uri;
+    };
+    struct PendingAttribute
+    {
+        StringView name;
+        StringView value;
+    };
+    std::unique_ptr<XMLNamespaceTable> namespaceStorage;
+    XMLNamespaceTable *namespaces;
+    std::vector<Binding> bindings;
+    std::vector<PendingAttribute> pending;
+
+private:
+    template <Flag F>
+    void fail(XMLParseError error_, std::size_t offset)
+    {
+        // An offset inside replacement text means nothing to the caller; report the
+        // reference it came from
+        if (reference)
+            offset = reference - s;
+        if (F & NoThrow)
+            error = error_, errorOffset = offset;
+        else
+            throw XMLParseException(error_, offset);
+    }
+    template <Flag F>
+    bool failed() const noexcept
+    {
+        return (F & NoThrow) && error != XMLParseError::None;
+    }
+    // Whether the whitespace run at p is a lone ' ', which NormalizeSpace leaves as it is
+    bool isSingleSpace() const noexcept
+    {
+        auto next = p + 1;
+        return *p == ' ' && !isCharType(next, Impl::SkipCharType::Space);
+    }
+    // End of the text [begin, q) without its trailing whitespace. Text decoded from
+    // references such as &#32; may be nothing but spaces, so stop at begin.
+    static char *trimTrailingSpace(const char *begin, char *q) noexcept
+    {
+        while (q != begin)
+        {
+            auto last = q - 1;
+            if (!isCharType(last, Impl::SkipCharType::Space))
+                break;
+            q = last;
+        }
+        return q;
+    }
+    template <Flag F, typename C>
+    void callback(C &&c)
+    {
+        if (F & Flag::Statistics)
+        {
+            auto start = std::chrono::steady_clock::now();
+            c();
+            statistics.callbackTime += std::chrono::steady_clock::now() - start;
+        }
+        else
+            c();
+    }
+
+private:
+    XMLParser(Allocator *allocator_, XMLNamespaceTable *namespaces_)
+        : limits(), entities(), expanded(), reference(), scratch(), storage(), allocator(allocator_ ? allocator_ : &storage),
+          namespaceStorage(), namespaces(namespaces_), bindings(), pending()
+    {
+    }
 
 private:
+    enum class ReferenceType
+    {
+        Invalid,
+        Character,
+        Entity,
+    };
+
+    // Decode the reference at p and advance past it. Character references and the five
+    // predefined entities are matched inline and yield c; anything else is looked up in
+    // the entities declared by the DOCTYPE.
     template <Flag F>
-    void parseReference(char *&q)
+    ReferenceType decodeReference(char &c, const XMLEntityTable::Entity *&entity)
     {
+        if (F & Flag::Statistics)
+            ++statistics.references;
 
         switch (p[1])
         {
 
         case 0:
-            throw XMLParseException("Unexpected end of data", p - s);
+            fail<F>(XMLParseError::UnexpectedEndOfData, p - s);
+            return ReferenceType::Invalid;
         case '#':
         {
 
@@ -347,7 +564,10 @@ private:
 
                 p += 3;
                 if (*p == ';')
-                    throw XMLParseException("Unexpected ;", p - s);
+                {
+                    fail<F>(XMLParseError::UnexpectedSemicolon, p - s);
+                    return ReferenceType::Invalid;
+                }
                 std::uint32_t code = 0;
                 unsigned char t = 0;
                 t = Impl::toHexadecimalChar(*p);
@@ -358,18 +578,24 @@ private:
                     t = Impl::toHexadecimalChar(*p);
                 }
                 if (*p != ';')
-                    throw XMLParseException("Expected ;", p - s);
+                {
+                    fail<F>(XMLParseError::ExpectedSemicolon, p - s);
+                    return ReferenceType::Invalid;
+                }
                 ++p;
                 // TODO: Code conversion
-                *q = code;
-                ++q;
+                c = static_cast<char>(code);
+                return ReferenceType::Character;
             }
             else
             {
 
                 p += 2;
                 if (*p == ';')
-                    throw XMLParseException("Unexpected ;", p - s);
+                {
+                    fail<F>(XMLParseError::UnexpectedSemicolon, p - s);
+                    return ReferenceType::Invalid;
+                }
                 std::uint32_t code = 0;
                 unsigned char t = 0;
                 t = Impl::toDecimalChar(*p);
@@ -380,13 +606,15 @@ private:
                     t = Impl::toDecimalChar(*p);
                 }
                 if (*p != ';')
-                    throw XMLParseException("Expected ;", p - s);
+                {
+                    fail<F>(XMLParseError::ExpectedSemicolon, p - s);
+                    return ReferenceType::Invalid;
+                }
                 ++p;
                 // TODO: Code conversion
-                *q = code;
-                ++q;
+                c = static_cast<char>(code);
+                return ReferenceType::Character;
             }
-            return;
         }
         case 'a':
         {
@@ -396,18 +624,16 @@ private:
 
                 // amp
                 p += 5;
-                *q = '&';
-                ++q;
-                return;
+                c = '&';
+                return ReferenceType::Character;
             }
             if (p[2] == 'p' && p[3] == 'o' && p[4] == 's' && p[5] == ';')
             {
 
                 // apos
                 p += 6;
-                *q = '\'';
-                ++q;
-                return;
+                c = '\'';
+                return ReferenceType::Character;
             }
             break;
         }
@@ -419,9 +645,8 @@ private:
 
                 // gt
                 p += 4;
-                *q = '>';
-                ++q;
-                return;
+                c = '>';
+                return ReferenceType::Character;
             }
             break;
         }
@@ -433,9 +658,8 @@ private:
 
                 // lt
                 p += 4;
-                *q = '<';
-                ++q;
-                return;
+                c = '<';
+                return ReferenceType::Character;
             }
             break;
         }
@@ -447,9 +671,8 @@ private:
 
                 // quot
                 p += 6;
-                *q = '"';
-                ++q;
-                return;
+                c = '"';
+                return ReferenceType::Character;
             }
             break;
         }
@@ -459,7 +682,162 @@ private:
             break;
         }
         }
-        throw XMLParseException("Invalid reference", p - s);
+        if (!entities.isEmpty())
+        {
+            auto end = p + 1;
+            while (*end && *end != ';' && *end != '&' && *end != '<' && !isCharType(end, Impl::SkipCharType::Space))
+                ++end;
+            if (*end == ';')
+            {
+                entity = entities.find(StringView(p + 1, end));
+                if (entity)
+                {
+                    p = end + 1;
+                    return ReferenceType::Entity;
+                }
+            }
+        }
+        fail<F>(XMLParseError::InvalidReference, p - s);
+        return ReferenceType::Invalid;
+    }
+    // Decode the reference at p into q in situ. Returns false when parsing failed or when
+    // the replacement text is longer than the space freed so far; p is then left at the
+    // '&' and the caller finishes the span with expandSpan.
+    template <Flag F>
+    bool parseReference(char *&q)
+    {
+        if (F & Flag::NonDestructive)
+            return false;
+        auto r = p;
+        char c;
+        const XMLEntityTable::Entity *entity;
+        switch (decodeReference<F>(c, entity))
+        {
+        case ReferenceType::Character:
+            *q = c;
+            ++q;
+            return true;
+        case ReferenceType::Entity:
+        {
+            auto value = entity->value;
+            if (entity->simple && value.getLength() <= static_cast<std::size_t>(p - q))
+            {
+                std::copy(value.begin(), value.end(), q);
+                q += value.getLength();
+                return true;
+            }
+            p = r;
+            return false;
+        }
+        default:
+            return false;
+        }
+    }
+    // Out-of-place continuation of a span whose decoded form does not fit in situ.
+    // [begin, q) holds what was decoded so far and p the rest of the span, which is
+    // scanned with T (one of the *NoRef types). The result is stored in the allocator;
+    // the returned pointer and q delimit it.
+    template <Flag F, Impl::SkipCharType T>
+    char *expandSpan(const char *begin, char *&q)
+    {
+        scratch.assign(begin, static_cast<const char *>(q));
+        while (true)
+        {
+            auto start = p;
+            auto len = skipChar(p, T);
+            if (*p == 0)
+            {
+                fail<F>(XMLParseError::UnexpectedEndOfData, p - s);
+                return nullptr;
+            }
+            scratch.append(start, len);
+            if (*p == '&')
+            {
+                if (!appendReference<F>(0))
+                    return nullptr;
+            }
+            else if ((T == Impl::SkipCharType::TextNoSpaceRef || T == Impl::SkipCharType::TextNoSpace) && *p != '<')
+            {
+                skipChar(p, Impl::SkipCharType::Space);
+                scratch.push_back(' ');
+            }
+            else
+                break;
+        }
+        auto data = static_cast<char *>(allocator->allocate(scratch.size() + 1, 1));
+        std::copy(scratch.begin(), scratch.end(), data);
+        q = data + scratch.size();
+        *q = 0;
+        return data;
+    }
+    template <Flag F>
+    bool appendReference(std::size_t level)
+    {
+        auto r = p;
+        char c;
+        const XMLEntityTable::Entity *entity;
+        switch (decodeReference<F>(c, entity))
+        {
+        case ReferenceType::Character:
+            scratch.push_back(c);
+            return true;
+        case ReferenceType::Entity:
+            return appendEntity<F>(*entity, level, r);
+        default:
+            return false;
+        }
+    }
+    // Append the replacement text of the reference at r, which p has been moved past
+    template <Flag F>
+    bool appendEntity(const XMLEntityTable::Entity &entity, std::size_t level, char *r)
+    {
+        auto value = entity.value;
+        if (entity.expanding)
+        {
+            fail<F>(XMLParseError::RecursiveEntity, r - s);
+            return false;
+        }
+        if (level >= limits.entityDepth)
+        {
+            fail<F>(XMLParseError::EntityDepthExceeded, r - s);
+            return false;
+        }
+        expanded += value.getLength();
+        auto consumed = static_cast<std::size_t>((reference ? reference : r) - s);
+        if (expanded > limits.entityExpansion + limits.entityAmplification * consumed)
+        {
+            fail<F>(XMLParseError::EntityExpansionExceeded, r - s);
+            return false;
+        }
+        if (entity.simple)
+        {
+            scratch.append(value.getData(), value.getLength());
+            return true;
+        }
+
+        // Decode nested references with p temporarily inside the value; errors in there
+        // are reported at the outermost reference
+        auto saved = p;
+        auto outer = reference;
+        if (!outer)
+            reference = r;
+        auto end = value.end();
+        entity.expanding = true;
+        p = const_cast<char *>(value.getData());
+        bool ok = true;
+        while (ok && p != end)
+        {
+            auto start = p;
+            while (p != end && *p != '&')
+                ++p;
+            scratch.append(start, p);
+            if (p != end)
+                ok = appendReference<F>(level + 1);
+        }
+        entity.expanding = false;
+        reference = outer;
+        p = saved;
+        return ok;
     }
     template <Flag F, typename H>
     void parseXMLDeclaration(H & /*handler*/)
@@ -469,11 +847,11 @@ private:
 
         // Parse "version"
         if (p[0] != 'v' || p[1] != 'e' || p[2] != 'r' || p[3] != 's' || p[4] != 'i' || p[5] != 'o' || p[6] != 'n')
-            throw XMLParseException("Expected version", p - s);
+            return fail<F>(XMLParseError::ExpectedVersion, p - s);
         p += 7;
         skipChar(p, Impl::SkipCharType::Space);
         if (*p != '=')
-            throw XMLParseException("Expected =", p - s);
+            return fail<F>(XMLParseError::ExpectedEquals, p - s);
         ++p;
         skipChar(p, Impl::SkipCharType::Space);
         if (*p == '"')
@@ -482,7 +860,7 @@ private:
             ++p;
             skipChar(p, Impl::SkipCharType::AttributeValue1);
             if (*p != '"')
-                throw XMLParseException("Expected \"", p - s);
+                return fail<F>(XMLParseError::ExpectedQuotationMark, p - s);
         }
         else if (*p == '\'')
         {
@@ -490,14 +868,14 @@ private:
             ++p;
             skipChar(p, Impl::SkipCharType::AttributeValue2);
             if (*p != '\'')
-                throw XMLParseException("Expected '", p - s);
+                return fail<F>(XMLParseError::ExpectedApostrophe, p - s);
         }
         else
-            throw XMLParseException("Expected \" or '", p - s);
+            return fail<F>(XMLParseError::ExpectedQuote, p - s);
         ++p;
 
         if (*p != '?' && !isCharType(p, Impl::SkipCharType::Space))
-            throw XMLParseException("Unexpected character", p - s);
+            return fail<F>(XMLParseError::UnexpectedCharacter, p - s);
         skipChar(p, Impl::SkipCharType::Space);
 
         // Parse "encoding"
@@ -507,7 +885,7 @@ private:
             p += 8;
             skipChar(p, Impl::SkipCharType::Space);
             if (*p != '=')
-                throw XMLParseException("Expected =", p - s);
+                return fail<F>(XMLParseError::ExpectedEquals, p - s);
             ++p;
             skipChar(p, Impl::SkipCharType::Space);
             if (*p == '"')
@@ -516,7 +894,7 @@ private:
                 ++p;
                 skipChar(p, Impl::SkipCharType::AttributeValue1);
                 if (*p != '"')
-                    throw XMLParseException("Expected \"", p - s);
+                    return fail<F>(XMLParseError::ExpectedQuotationMark, p - s);
             }
             else if (*p == '\'')
             {
@@ -524,15 +902,15 @@ private:
                 ++p;
                 skipChar(p, Impl::SkipCharType::AttributeValue2);
                 if (*p != '\'')
-                    throw XMLParseException("Expected '", p - s);
+                    return fail<F>(XMLParseError::ExpectedApostrophe, p - s);
             }
             else
-                throw XMLParseException("Expected \" or '", p - s);
+                return fail<F>(XMLParseError::ExpectedQuote, p - s);
             ++p;
         }
 
         if (*p != '?' && !isCharType(p, Impl::SkipCharType::Space))
-            throw XMLParseException("Unexpected character", p - s);
+            return fail<F>(XMLParseError::UnexpectedCharacter, p - s);
         skipChar(p, Impl::SkipCharType::Space);
 
         // Parse "standalone"
@@ -542,7 +920,7 @@ private:
             p += 10;
             skipChar(p, Impl::SkipCharType::Space);
             if (*p != '=')
-                throw XMLParseException("Expected =", p - s);
+                return fail<F>(XMLParseError::ExpectedEquals, p - s);
             ++p;
             skipChar(p, Impl::SkipCharType::Space);
             if (*p == '"')
@@ -551,7 +929,7 @@ private:
                 ++p;
                 skipChar(p, Impl::SkipCharType::AttributeValue1);
                 if (*p != '"')
-                    throw XMLParseException("Expected \"", p - s);
+                    return fail<F>(XMLParseError::ExpectedQuotationMark, p - s);
             }
             else if (*p == '\'')
             {
@@ -559,23 +937,224 @@ private:
                 ++p;
                 skipChar(p, Impl::SkipCharType::AttributeValue2);
                 if (*p != '\'')
-                    throw XMLParseException("Expected '", p - s);
+                    return fail<F>(XMLParseError::ExpectedApostrophe, p - s);
             }
             else
-                throw XMLParseException("Expected \" or '", p - s);
+                return fail<F>(XMLParseError::ExpectedQuote, p - s);
             ++p;
         }
 
         skipChar(p, Impl::SkipCharType::Space);
         if (p[0] != '?' || p[1] != '>')
-            throw XMLParseException("Expected ?>", p - s);
+            return fail<F>(XMLParseError::ExpectedDeclarationEnd, p - s);
         p += 2;
     }
+    template <Flag F>
+    bool skipLiteral(StringView &literal)
+    {
+        auto quote = *p;
+        if (quote != '"' && quote != '\'')
+        {
+            fail<F>(XMLParseError::ExpectedQuote, p - s);
+            return false;
+        }
+        auto begin = ++p;
+        while (*p && *p != quote)
+            ++p;
+        if (!*p)
+        {
+            fail<F>(XMLParseError::UnexpectedEndOfData, p - s);
+            return false;
+        }
+        literal.setData(begin, p - begin);
+        ++p;
+        return true;
+    }
+    template <Flag F>
+    bool skipRequiredSpace()
+    {
+        if (skipChar(p, Impl::SkipCharType::Space))
+            return true;
+        fail<F>(XMLParseError::ExpectedWhiteSpace, p - s);
+        return false;
+    }
+    // Skip "SYSTEM" S SystemLiteral or "PUBLIC" S PubidLiteral S SystemLiteral if present
+    template <Flag F>
+    bool skipExternalID(bool &present)
+    {
+        StringView literal;
+        present = false;
+        if (p[0] == 'S' && p[1] == 'Y' && p[2] == 'S' && p[3] == 'T' && p[4] == 'E' && p[5] == 'M')
+        {
+            p += 6;
+            present = true;
+            return skipRequiredSpace<F>() && skipLiteral<F>(literal);
+        }
+        if (p[0] == 'P' && p[1] == 'U' && p[2] == 'B' && p[3] == 'L' && p[4] == 'I' && p[5] == 'C')
+        {
+            p += 6;
+            present = true;
+            return skipRequiredSpace<F>() && skipLiteral<F>(literal) && skipRequiredSpace<F>() && skipLiteral<F>(literal);
+        }
+        return true;
+    }
+    template <Flag F>
+    void parseEntityDeclaration()
+    {
+        if (!skipRequiredSpace<F>())
+            return;
+        bool parameter = false;
+        if (*p == '%')
+        {
+            // Parameter entities are only meaningful inside the DTD, which is not processed
+            parameter = true;
+            ++p;
+            if (!skipRequiredSpace<F>())
+                return;
+        }
+        StringView name(p, 1);
+        while (*p && *p != '>' && *p != '"' && *p != '\'' && !isCharType(p, Impl::SkipCharType::Space))
+            ++p;
+        name.setLength(p - name.getData());
+        if (!name.getLength())
+            return fail<F>(XMLParseError::ExpectedElementType, p - s);
+        if (!skipRequiredSpace<F>())
+            return;
+
+        if (*p == '"' || *p == '\'')
+        {
+            StringView value;
+            if (!skipLiteral<F>(value))
+                return;
+            // Replacement text is only ever treated as character data
+            if (std::find(value.begin(), value.end(), '<') != value.end())
+                return fail<F>(XMLParseError::InvalidEntityValue, value.getData() - s);
+            if (!parameter)
+                entities.insert(name, value);
+        }
+        else
+        {
+            // External entities are never loaded; references to them stay undeclared
+            bool external;
+            if (!skipExternalID<F>(external))
+                return;
+            if (!external)
+                return fail<F>(XMLParseError::ExpectedQuote, p - s);
+            skipChar(p, Impl::SkipCharType::Space);
+            if (p[0] == 'N' && p[1] == 'D' && p[2] == 'A' && p[3] == 'T' && p[4] == 'A')
+            {
+                p += 5;
+                if (!skipRequiredSpace<F>())
+                    return;
+                skipChar(p, Impl::SkipCharType::AttributeName);
+            }
+        }
+        skipChar(p, Impl::SkipCharType::Space);
+        if (*p != '>')
+            return fail<F>(XMLParseError::ExpectedGreaterThan, p - s);
+        ++p;
+    }
+    template <Flag F>
+    void parseInternalSubset()
+    {
+        while (true)
+        {
+            skipChar(p, Impl::SkipCharType::Space);
+            if (*p == ']')
+            {
+                ++p;
+                return;
+            }
+            if (*p == '%')
+            {
+                // Parameter entity reference
+                while (*p && *p != ';')
+                    ++p;
+                if (!*p)
+                    return fail<F>(XMLParseError::UnexpectedEndOfData, p - s);
+                ++p;
+            }
+            else if (*p == '<' && p[1] == '!' && p[2] == '-' && p[3] == '-')
+            {
+                p += 4;
+                while (*p && (p[0] != '-' || p[1] != '-' || p[2] != '>'))
+                    ++p;
+                if (!*p)
+                    return fail<F>(XMLParseError::UnexpectedEndOfData, p - s);
+                p += 3;
+            }
+            else if (*p == '<' && p[1] == '?')
+            {
+                p += 2;
+                while (*p && (p[0] != '?' || p[1] != '>'))
+                    ++p;
+                if (!*p)
+                    return fail<F>(XMLParseError::UnexpectedEndOfData, p - s);
+                p += 2;
+            }
+            else if (*p == '<' && p[1] == '!' && p[2] == 'E' && p[3] == 'N' && p[4] == 'T' && p[5] == 'I' && p[6] == 'T' && p[7] == 'Y')
+            {
+                // "<!ENTITY"
+                p += 8;
+                parseEntityDeclaration<F>();
+                if (failed<F>())
+                    return;
+            }
+            else if (*p == '<' && p[1] == '!')
+            {
+                // ELEMENT, ATTLIST and NOTATION declarations are skipped
+                p += 2;
+                StringView literal;
+                while (*p && *p != '>')
+                {
+                    if (*p == '"' || *p == '\'')
+                    {
+                        if (!skipLiteral<F>(literal))
+                            return;
+                    }
+                    else
+                        ++p;
+                }
+                if (!*p)
+                    return fail<F>(XMLParseError::UnexpectedEndOfData, p - s);
+                ++p;
+            }
+            else if (!*p)
+                return fail<F>(XMLParseError::UnexpectedEndOfData, p - s);
+            else
+                return fail<F>(XMLParseError::UnexpectedCharacter, p - s);
+        }
+    }
     template <Flag F, typename H>
-    void parseDoctype(H & /*handler*/)
+    void parseDoctype(H &handler)
     {
 
-        throw XMLParseException("Not implemented", p - s);
+        if (!skipRequiredSpace<F>())
+            return;
+        StringView name(p, 1);
+        while (*p && *p != '>' && *p != '[' && !isCharType(p, Impl::SkipCharType::Space))
+            ++p;
+        name.setLength(p - name.getData());
+        if (!name.getLength())
+            return fail<F>(XMLParseError::ExpectedElementType, p - s);
+        skipChar(p, Impl::SkipCharType::Space);
+
+        bool external;
+        if (!skipExternalID<F>(external))
+            return;
+        skipChar(p, Impl::SkipCharType::Space);
+        if (*p == '[')
+        {
+            ++p;
+            parseInternalSubset<F>();
+            if (failed<F>())
+                return;
+            skipChar(p, Impl::SkipCharType::Space);
+        }
+        if (*p != '>')
+            return fail<F>(XMLParseError::ExpectedGreaterThan, p - s);
+        ++p;
+        callback<F>([&] { handler.doctype(); });
     }
     template <Flag F, typename H>
     void parseComment(H &handler)
@@ -586,10 +1165,10 @@ private:
         while (*p && (p[0] != '-' || p[1] != '-' || p[2] != '>'))
             ++p;
         if (!*p)
-            throw XMLParseException("Unexpected end of data", p - s);
+            return fail<F>(XMLParseError::UnexpectedEndOfData, p - s);
         comment.setLength(p - comment.getData());
         p += 3;
-        handler.comment(comment);
+        callback<F>([&] { handler.comment(comment); });
     }
     template <Flag F, typename H>
     void parseProcessingInstruction(H &handler)
@@ -598,21 +1177,21 @@ private:
         StringView target(p, 1);
         target.setLength(skipChar(p, Impl::SkipCharType::Name));
         if (!target.getLength())
-            throw XMLParseException("Expected PI target", p - s);
+            return fail<F>(XMLParseError::ExpectedPITarget, p - s);
         if ((p[0] != '?' || p[1] != '>') &&
             !skipChar(p, Impl::SkipCharType::Space))
-            throw XMLParseException("Expected white space", p - s);
+            return fail<F>(XMLParseError::ExpectedWhiteSpace, p - s);
 
         StringView content(p, 1);
         // Until "?>"
         while (*p && (p[0] != '?' || p[1] != '>'))
             ++p;
         if (!*p)
-            throw XMLParseException("Unexpected end of data", p - s);
+            return fail<F>(XMLParseError::UnexpectedEndOfData, p - s);
         content.setLength(p - content.getData());
         p += 2;
 
-        handler.processingInstruction(target, content);
+        callback<F>([&] { handler.processingInstruction(target, content); });
     }
     template <Flag F, typename H>
     void parseCDATA(H &handler)
@@ -623,41 +1202,153 @@ private:
         while (*p && (p[0] != ']' || p[1] != ']' || p[2] != '>'))
             ++p;
         if (!*p)
-            throw XMLParseException("Unexpected end of data", p - s);
+            return fail<F>(XMLParseError::UnexpectedEndOfData, p - s);
         text.setLength(p - text.getData());
         p += 3;
-        handler.cdata(text);
+        callback<F>([&] { handler.cdata(text); });
+    }
+    template <Flag F>
+    bool resolveName(StringView name, bool element, XMLQualifiedName &qname)
+    {
+        auto colon = std::find(name.begin(), name.end(), ':');
+        qname.name = name;
+        if (colon == name.end())
+        {
+            qname.localName = name;
+            qname.uri = XMLNamespace::None;
+            if (!element)
+            {
+                // Unprefixed attributes are in no namespace, whatever the default
+                if (name == StringView("xmlns", 5))
+                    qname.uri = XMLNamespace::XMLNS;
+                return true;
+            }
+            for (auto it = bindings.rbegin(); it != bindings.rend(); ++it)
+            {
+                if (!it->prefix.getLength())
+                {
+                    qname.uri = it->uri;
+                    break;
+                }
+            }
+            return true;
+        }
+        StringView prefix(name.begin(), colon);
+        qname.localName = StringView(colon + 1, name.end());
+        if (prefix == StringView("xml", 3))
+        {
+            qname.uri = XMLNamespace::XML;
+            return true;
+        }
+        if (prefix == StringView("xmlns", 5))
+        {
+            qname.uri = XMLNamespace::XMLNS;
+            return true;
+        }
+        for (auto it = bindings.rbegin(); it != bindings.rend(); ++it)
+        {
+            if (it->prefix == prefix)
+            {
+                qname.uri = it->uri;
+                return true;
+            }
+        }
+        fail<F>(XMLParseError::UnboundPrefix, name.getData() - s);
+        return false;
     }
+    // Bind the xmlns declarations among the pending attributes, then report the element
+    // and its attributes with resolved names
     template <Flag F, typename H>
-    void parseElement(H &handler)
+    bool startElementNS(H &handler, XMLQualifiedName &qname)
+    {
+        for (auto &attribute : pending)
+        {
+            auto &name = attribute.name;
+            if (name.getLength() < 5 || StringView(name.getData(), 5) != StringView("xmlns", 5))
+                continue;
+            StringView prefix;
+            if (name.getLength() > 5)
+            {
+                if (name[5] != ':')
+                    continue;
+                prefix = StringView(name.getData() + 6, name.getLength() - 6);
+            }
+            auto uri = namespaces->intern(attribute.value);
+            bool valid;
+            if (prefix == StringView("xml", 3))
+                valid = uri == XMLNamespace::XML;
+            else
+                valid = prefix != StringView("xmlns", 5) && uri != XMLNamespace::XMLNS && uri != XMLNamespace::XML &&
+                        (uri != XMLNamespace::None || !prefix.getLength());
+            if (!valid)
+            {
+                fail<F>(XMLParseError::InvalidNamespaceDeclaration, name.getData() - s);
+                return false;
+            }
+            bindings.push_back({prefix, uri});
+        }
+        if (!resolveName<F>(qname.name, true, qname))
+            return false;
+        callback<F>([&] { handler.startElementNS(qname); });
+        for (auto &attribute : pending)
+        {
+            XMLQualifiedName name;
+            if (!resolveName<F>(attribute.name, false, name))
+                return false;
+            callback<F>([&] { handler.attributeNS(name, attribute.value); });
+        }
+        pending.clear();
+        return true;
+    }
+    // Parse the start tag after '<', reporting the element and its attributes
+    template <Flag F, typename H>
+    void parseStartTag(H &handler, StringView &name, XMLQualifiedName &qname, bool &empty)
     {
+        // Values that no callback sees are left as they are
+        constexpr bool decode = F & Flag::EntityTranslation && (F & Flag::Namespaces || XMLHandlerTraits<H>::attribute);
 
         // Parse element type
-        StringView name(p, 1);
+        name.setData(p, 1);
         name.setLength(skipChar(p, Impl::SkipCharType::Name));
         if (!name.getLength())
-            throw XMLParseException("Expected element type", p - s);
-        bool empty = false;
+            return fail<F>(XMLParseError::ExpectedElementType, p - s);
+        if (*p == 0)
+            return fail<F>(XMLParseError::UnexpectedEndOfData, p - s);
+        if (F & Flag::Namespaces)
+            qname.name = name;
+        if (++depth > limits.depth)
+            return fail<F>(XMLParseError::DepthLimitExceeded, name.getData() - 1 - s);
+        if (++elementCount > limits.elements)
+            return fail<F>(XMLParseError::ElementLimitExceeded, name.getData() - 1 - s);
+        if (F & Flag::Statistics)
+        {
+            ++statistics.elements;
+            statistics.maxDepth = std::max(statistics.maxDepth, depth);
+        }
+        empty = false;
         if (*p == '>')
         {
 
             ++p;
-            handler.startElement(name);
+            if (!(F & Flag::Namespaces))
+                callback<F>([&] { handler.startElement(name); });
         }
         else if (*p == '/')
         {
 
             if (p[1] != '>')
-                throw XMLParseException("eExpected >", p + 1 - s);
+                return fail<F>(XMLParseError::ExpectedGreaterThan, p + 1 - s);
             p += 2;
-            handler.startElement(name);
+            if (!(F & Flag::Namespaces))
+                callback<F>([&] { handler.startElement(name); });
             empty = true;
         }
         else
         {
 
             ++p;
-            handler.startElement(name);
+            if (!(F & Flag::Namespaces))
+                callback<F>([&] { handler.startElement(name); });
             skipChar(p, Impl::SkipCharType::Space);
             while (!isCharType(p, Impl::SkipCharType::AttributeName))
             {
@@ -666,10 +1357,10 @@ private:
                 StringView name(p, 1);
                 name.setLength(skipChar(p, Impl::SkipCharType::AttributeName));
                 if (!name.getLength())
-                    throw XMLParseException("Expected attribute name", p - s);
+                    return fail<F>(XMLParseError::ExpectedAttributeName, p - s);
                 skipChar(p, Impl::SkipCharType::Space);
                 if (*p != '=')
-                    throw XMLParseException("Expected =", p - s);
+                    return fail<F>(XMLParseError::ExpectedEquals, p - s);
                 ++p;
                 skipChar(p, Impl::SkipCharType::Space);
 
@@ -680,7 +1371,7 @@ private:
 
                     ++p;
                     value.setData(p, 0);
-                    if (F & Flag::EntityTranslation)
+                    if (decode)
                     {
 
                         auto q = p;
@@ -689,12 +1380,22 @@ private:
 
                             auto len = skipChar(p, Impl::SkipCharType::AttributeValueNoRef1);
                             if (*p == 0)
-                                throw XMLParseException("Unexpected end of data", p - s);
+                                return fail<F>(XMLParseError::UnexpectedEndOfData, p - s);
                             if (p != q + len)
-                                std::copy(q, q + len, p - len);
+                                std::copy(p - len, p, q);
                             q += len;
                             if (*p == '&')
-                                parseReference<F>(q);
+                            {
+                                if (!parseReference<F>(q))
+                                {
+                                    if (failed<F>())
+                                        return;
+                                    value.setData(expandSpan<F, Impl::SkipCharType::AttributeValueNoRef1>(value.getData(), q), 0);
+                                    if (failed<F>())
+                                        return;
+                                    break;
+                                }
+                            }
                             else
                                 break;
                         }
@@ -705,7 +1406,7 @@ private:
 
                         value.setLength(skipChar(p, Impl::SkipCharType::AttributeValue1));
                         if (*p == 0)
-                            throw XMLParseException("Unexpected end of data", p - s);
+                            return fail<F>(XMLParseError::UnexpectedEndOfData, p - s);
                     }
                     ++p;
                 }
@@ -714,7 +1415,7 @@ private:
 
                     ++p;
                     value.setData(p, 0);
-                    if (F & Flag::EntityTranslation)
+                    if (decode)
                     {
 
                         auto q = p;
@@ -723,12 +1424,22 @@ private:
 
                             auto len = skipChar(p, Impl::SkipCharType::AttributeValueNoRef2);
                             if (*p == 0)
-                                throw XMLParseException("Unexpected end of data", p - s);
+                                return fail<F>(XMLParseError::UnexpectedEndOfData, p - s);
                             if (p != q + len)
-                                std::copy(q, q + len, p - len);
+                                std::copy(p - len, p, q);
                             q += len;
                             if (*p == '&')
-                                parseReference<F>(q);
+                            {
+                                if (!parseReference<F>(q))
+                                {
+                                    if (failed<F>())
+                                        return;
+                                    value.setData(expandSpan<F, Impl::SkipCharType::AttributeValueNoRef2>(value.getData(), q), 0);
+                                    if (failed<F>())
+                                        return;
+                                    break;
+                                }
+                            }
                             else
                                 break;
                         }
@@ -739,13 +1450,20 @@ private:
 
                         value.setLength(skipChar(p, Impl::SkipCharType::AttributeValue2));
                         if (*p == 0)
-                            throw XMLParseException("Unexpected end of data", p - s);
+                            return fail<F>(XMLParseError::UnexpectedEndOfData, p - s);
                     }
                     ++p;
                 }
                 else
-                    throw XMLParseException("Expected \" or '", p - s);
-                handler.attribute(name, value);
+                    return fail<F>(XMLParseError::ExpectedQuote, p - s);
+                if (++attributeCount > limits.attributes)
+                    return fail<F>(XMLParseError::AttributeLimitExceeded, name.getData() - s);
+                if (F & Flag::Statistics)
+                    ++statistics.attributes;
+                if (F & Flag::Namespaces)
+                    pending.push_back({name, value});
+                else
+                    callback<F>([&] { handler.attribute(name, value); });
                 skipChar(p, Impl::SkipCharType::Space);
             }
             if (*p == '>')
@@ -757,151 +1475,257 @@ private:
             {
 
                 if (p[1] != '>')
-                    throw XMLParseException("Expected >", p + 1 - s);
+                    return fail<F>(XMLParseError::ExpectedGreaterThan, p + 1 - s);
                 p += 2;
                 empty = true;
             }
             else
-                throw XMLParseException("Unexpected character", p + 1 - s);
+                return fail<F>(XMLParseError::UnexpectedCharacter, p + 1 - s);
         }
-        handler.endAttributes(empty);
-        if (!empty)
+        if (F & Flag::Namespaces)
         {
+            if (!startElementNS<F>(handler, qname))
+                return;
+        }
+        callback<F>([&] { handler.endAttributes(empty); });
+    }
+    // Parse character data up to the next '<', if there is any
+    template <Flag F, typename H>
+    void parseText(H &handler)
+    {
 
-            bool c = true;
-            do
+        // Parse text
+        if (F & Flag::TrimSpace)
+        {
+            skipChar(p, Impl::SkipCharType::Space);
+        }
+        if (*p != '<')
+        {
+
+            if (!XMLHandlerTraits<H>::text)
             {
 
-                // Parse text
-                if (F & Flag::TrimSpace)
-                {
-                    skipChar(p, Impl::SkipCharType::Space);
-                }
-                if (*p != '<')
+                // Nothing sees it, so only find its end
+                skipChar(p, Impl::SkipCharType::Text);
+                if (*p == 0)
+                    return fail<F>(XMLParseError::UnexpectedEndOfData, p - s);
+                if (F & Flag::Statistics)
+                    ++statistics.texts;
+            }
+            else if (F & Flag::EntityTranslation)
+            {
+
+                if (F & Flag::NormalizeSpace)
                 {
 
-                    if (F & Flag::EntityTranslation)
+                    StringView text(p, 1);
+                    auto q = p;
+                    while (true)
                     {
 
-                        if (F & Flag::NormalizeSpace)
+                        auto len = skipChar(p, Impl::SkipCharType::TextNoSpaceRef);
+                        if (*p == 0)
+                            return fail<F>(XMLParseError::UnexpectedEndOfData, p - s);
+                        if (p != q + len)
+                            std::copy(p - len, p, q);
+                        q += len;
+                        if (*p == '&')
                         {
-
-                            StringView text(p, 1);
-                            auto q = p;
-                            while (true)
+                            if (!parseReference<F>(q))
                             {
-
-                                auto len = skipChar(p, Impl::SkipCharType::TextNoSpaceRef);
-                                if (*p == 0)
-                                    throw XMLParseException("Unexpected end of data", p - s);
-                                if (p != q + len)
-                                    std::copy(p - len, p, q);
-                                q += len;
-                                if (*p == '&')
-                                    parseReference<F>(q);
-                                else if (*p != '<')
-                                {
-                                    skipChar(p, Impl::SkipCharType::Space);
-                                    *(q++) = ' ';
-                                }
-                                else
-                                    break;
+                                if (failed<F>())
+                                    return;
+                                text.setData(expandSpan<F, Impl::SkipCharType::TextNoSpaceRef>(text.getData(), q), 0);
+                                if (failed<F>())
+                                    return;
+                                break;
                             }
-                            if (F & Flag::TrimSpace && q[-1] == ' ')
-                                --q;
-                            text.setLength(q - text.getData());
-                            handler.text(text);
                         }
-                        else
+                        else if (*p != '<')
                         {
-
-                            StringView text(p, 1);
-                            auto q = p;
-                            while (true)
-                            {
-
-                                auto len = skipChar(p, Impl::SkipCharType::TextNoRef);
-                                if (*p == 0)
-                                    throw XMLParseException("Unexpected end of data", p - s);
-                                if (p != q + len)
-                                    std::copy(p - len, p, q);
-                                q += len;
-                                if (*p == '&')
-                                    parseReference<F>(q);
-                                else
-                                    break;
-                            }
-                            --q;
-                            if (F & Flag::TrimSpace)
+                            if (F & Flag::NonDestructive && !isSingleSpace())
                             {
-                                while (isCharType(q, Impl::SkipCharType::Space))
-                                {
-                                    --q;
-                                }
+                                text.setData(expandSpan<F, Impl::SkipCharType::TextNoSpaceRef>(text.getData(), q), 0);
+                                if (failed<F>())
+                                    return;
+                                break;
                             }
-                            ++q;
-                            text.setLength(q - text.getData());
-                            handler.text(text);
+                            skipChar(p, Impl::SkipCharType::Space);
+                            if (F & Flag::NonDestructive)
+                                ++q;
+                            else
+                                *(q++) = ' ';
                         }
+                        else
+                            break;
                     }
-                    else
+                    if (F & Flag::TrimSpace && q != text.getData() && q[-1] == ' ')
+                        --q;
+                    text.setLength(q - text.getData());
+                    if (F & Flag::Statistics)
+                        ++statistics.texts;
+                    callback<F>([&] { handler.text(text); });
+                }
+                else
+                {
+
+                    StringView text(p, 1);
+                    auto q = p;
+                    while (true)
                     {
 
-                        if (F & Flag::NormalizeSpace)
+                        auto len = skipChar(p, Impl::SkipCharType::TextNoRef);
+                        if (*p == 0)
+                            return fail<F>(XMLParseError::UnexpectedEndOfData, p - s);
+                        if (p != q + len)
+                            std::copy(p - len, p, q);
+                        q += len;
+                        if (*p == '&')
                         {
-
-                            StringView text(p, 1);
-                            auto q = p;
-                            while (true)
+                            if (!parseReference<F>(q))
                             {
-
-                                auto len = skipChar(p, Impl::SkipCharType::TextNoSpace);
-                                if (*p == 0)
-                                    throw XMLParseException("Unexpected end of data", p - s);
-                                if (p != q + len)
-                                    std::copy(p - len, p, q);
-                                q += len;
-                                if (*p != '<')
-                                {
-                                    skipChar(p, Impl::SkipCharType::Space);
-                                    *(q++) = ' ';
-                                }
-                                else
-                                    break;
-                            }
-                            --q;
-                            if (F & Flag::TrimSpace)
-                            {
-                                while (isCharType(q, Impl::SkipCharType::Space))
-                                {
-                                    --q;
-                                }
+                                if (failed<F>())
+                                    return;
+                                text.setData(expandSpan<F, Impl::SkipCharType::TextNoRef>(text.getData(), q), 0);
+                                if (failed<F>())
+                                    return;
+                                break;
                             }
-                            ++q;
-                            text.setLength(q - text.getData());
-                            handler.text(text);
                         }
                         else
-                        {
+                            break;
+                    }
+                    if (F & Flag::TrimSpace)
+                        q = trimTrailingSpace(text.getData(), q);
+                    text.setLength(q - text.getData());
+                    if (F & Flag::Statistics)
+                        ++statistics.texts;
+                    callback<F>([&] { handler.text(text); });
+                }
+            }
+            else
+            {
 
-                            StringView text(p, 1);
-                            skipChar(p, Impl::SkipCharType::Text);
-                            if (*p == 0)
-                                throw XMLParseException("Unexpected end of data", p - s);
-                            auto q = p - 1;
-                            if (F & Flag::TrimSpace)
+                if (F & Flag::NormalizeSpace)
+                {
+
+                    StringView text(p, 1);
+                    auto q = p;
+                    while (true)
+                    {
+
+                        auto len = skipChar(p, Impl::SkipCharType::TextNoSpace);
+                        if (*p == 0)
+                            return fail<F>(XMLParseError::UnexpectedEndOfData, p - s);
+                        if (p != q + len)
+                            std::copy(p - len, p, q);
+                        q += len;
+                        if (*p != '<')
+                        {
+                            if (F & Flag::NonDestructive && !isSingleSpace())
                             {
-                                while (isCharType(q, Impl::SkipCharType::Space))
-                                {
-                                    --q;
-                                }
+                                text.setData(expandSpan<F, Impl::SkipCharType::TextNoSpace>(text.getData(), q), 0);
+                                if (failed<F>())
+                                    return;
+                                break;
                             }
-                            ++q;
-                            text.setLength(q - text.getData());
-                            handler.text(text);
+                            skipChar(p, Impl::SkipCharType::Space);
+                            if (F & Flag::NonDestructive)
+                                ++q;
+                            else
+                                *(q++) = ' ';
                         }
+                        else
+                            break;
                     }
+                    if (F & Flag::TrimSpace)
+                        q = trimTrailingSpace(text.getData(), q);
+                    text.setLength(q - text.getData());
+                    if (F & Flag::Statistics)
+                        ++statistics.texts;
+                    callback<F>([&] { handler.text(text); });
+                }
+                else
+                {
+
+                    StringView text(p, 1);
+                    skipChar(p, Impl::SkipCharType::Text);
+                    if (*p == 0)
+                        return fail<F>(XMLParseError::UnexpectedEndOfData, p - s);
+                    auto q = p;
+                    if (F & Flag::TrimSpace)
+                        q = trimTrailingSpace(text.getData(), q);
+                    text.setLength(q - text.getData());
+                    if (F & Flag::Statistics)
+                        ++statistics.texts;
+                    callback<F>([&] { handler.text(text); });
                 }
+            }
+        }
+    }
+    // Parse the end tag after "</" of the element started as name
+    template <Flag F, typename H>
+    void parseEndTag(H &handler, StringView name, const XMLQualifiedName &qname)
+    {
+
+        if (F & Flag::ClosingTagValidate)
+        {
+
+            StringView endName(p, 1);
+            skipChar(p, Impl::SkipCharType::Name);
+            endName.setLength(p - endName.getData());
+            skipChar(p, Impl::SkipCharType::Space);
+            if (*p != '>')
+                return fail<F>(XMLParseError::ExpectedGreaterThan, p - s);
+            ++p;
+            if (F & Flag::Namespaces)
+                callback<F>([&] { handler.endElementNS(qname); });
+            else
+                callback<F>([&] { handler.endElement(endName); });
+        }
+        else
+        {
+
+            // The buffer may end before name.getLength() more bytes, so compare only up to
+            // the first difference: strncmp stops there or at the terminator, which no name
+            // contains, and the C library compares long names a vector at a time
+            StringView endName(p, name.getLength());
+            if (std::strncmp(p, name.getData(), name.getLength()))
+                return fail<F>(XMLParseError::UnmatchedElementType, p - s);
+            p += name.getLength();
+            skipChar(p, Impl::SkipCharType::Space);
+            if (*p != '>')
+                return fail<F>(XMLParseError::ExpectedGreaterThan, p - s);
+            ++p;
+            if (F & Flag::Namespaces)
+                callback<F>([&] { handler.endElementNS(qname); });
+            else
+                callback<F>([&] { handler.endElement(endName); });
+        }
+    }
+    template <Flag F, typename H>
+    void parseElement(H &handler)
+    {
+
+        StringView name;
+        XMLQualifiedName qname;
+        bool empty;
+        std::size_t mark = 0;
+        if (F & Flag::Namespaces)
+            mark = bindings.size();
+        parseStartTag<F>(handler, name, qname, empty);
+        if (failed<F>())
+            return;
+        if (!empty)
+        {
+
+            bool c = true;
+            do
+            {
+
+                parseText<F>(handler);
+                if (failed<F>())
+                    return;
 
                 ++p;
                 switch (*p)
@@ -916,6 +1740,8 @@ private:
 
                         p += 2;
                         parseComment<F>(handler);
+                        if (failed<F>())
+                            return;
                     }
                     else if (p[0] == '[' && p[1] == 'C' && p[2] == 'D' && p[3] == 'A' && p[4] == 'T' && p[5] == 'A' && p[6] == '[')
                     {
@@ -923,40 +1749,20 @@ private:
                         // "[CDATA["
                         p += 7;
                         parseCDATA<F>(handler);
+                        if (failed<F>())
+                            return;
                     }
                     else
-                        throw XMLParseException("Unexpected character", p - s);
+                        return fail<F>(XMLParseError::UnexpectedCharacter, p - s);
                     break;
                 }
                 case '/':
                 {
 
                     ++p;
-                    if (F & Flag::ClosingTagValidate)
-                    {
-
-                        StringView endName(p, 1);
-                        skipChar(p, Impl::SkipCharType::Name);
-                        endName.setLength(p - endName.getData());
-                        skipChar(p, Impl::SkipCharType::Space);
-                        if (*p != '>')
-                            throw XMLParseException("Expected >", p - s);
-                        ++p;
-                        handler.endElement(endName);
-                    }
-                    else
-                    {
-
-                        StringView endName(p, name.getLength());
-                        if (endName != name)
-                            throw XMLParseException("Unmatch element type", p - s);
-                        p += name.getLength();
-                        skipChar(p, Impl::SkipCharType::Space);
-                        if (*p != '>')
-                            throw XMLParseException("Expected >", p - s);
-                        ++p;
-                        handler.endElement(endName);
-                    }
+                    parseEndTag<F>(handler, name, qname);
+                    if (failed<F>())
+                        return;
                     c = false;
                     break;
                 }
@@ -965,31 +1771,58 @@ private:
 
                     ++p;
                     parseProcessingInstruction<F>(handler);
+                    if (failed<F>())
+                        return;
                     break;
                 }
                 default:
                 {
 
                     parseElement<F>(handler);
+                    if (failed<F>())
+                        return;
                     break;
                 }
                 }
 
             } while (c);
         }
+        if (F & Flag::Namespaces)
+            bindings.erase(bindings.begin() + mark, bindings.end());
+        --depth;
     }
 
-public:
-    XMLParser() = default;
-
-    template <Flag F = Flag::Default, typename H>
-    void parse(char *data, H &handler)
+    template <Flag F>
+    void reset(char *data)
     {
-        assert(data);
-
         s = data;
         p = data;
-        handler.startDocument();
+        depth = 0;
+        elementCount = 0;
+        attributeCount = 0;
+        error = XMLParseError::None;
+        errorOffset = 0;
+        entities.clear();
+        expanded = 0;
+        reference = nullptr;
+        if (allocator == &storage)
+            storage.clear();
+        if (F & Flag::Namespaces)
+        {
+            if (!namespaces)
+            {
+                namespaceStorage.reset(new XMLNamespaceTable());
+                namespaces = namespaceStorage.get();
+            }
+            bindings.clear();
+            pending.clear();
+        }
+        statistics = Statistics();
+    }
+    // Parse the BOM and XML declaration, if present
+    template <Flag F, typename H>
+    void parseDeclaration(H &handler)
+    {
 
         // Parse BOM
         if (static_cast<unsigned char>(p[0]) == 0xEF &&
@@ -1008,6 +1841,26 @@ public:
             p += 6;
             parseXMLDeclaration<F>(handler);
         }
+    }
+    template <Flag F, typename H>
+    void parseDocument(char *data, H &handler)
+    {
+        assert(data);
+
+        reset<F>(data);
+        std::chrono::steady_clock::time_point start;
+        if (F & Flag::Statistics)
+            start = std::chrono::steady_clock::now();
+        callback<F>([&] { handler.startDocument(); });
+        parseDeclaration<F>(handler);
+        if (failed<F>())
+            return;
+        if (F & Flag::Statistics)
+        {
+            auto now = std::chrono::steady_clock::now();
+            statistics.declarationTime = now - start;
+            start = now;
+        }
         while (true)
         {
 
@@ -1027,6 +1880,8 @@ public:
 
                         p += 2;
                         parseComment<F>(handler);
+                        if (failed<F>())
+                            return;
                     }
                     else if (p[0] == 'D' && p[1] == 'O' && p[2] == 'C' && p[3] == 'T' && p[4] == 'Y' && p[5] == 'P' && p[6] == 'E')
                     {
@@ -1034,28 +1889,105 @@ public:
                         // "DOCTYPE"
                         p += 7;
                         parseDoctype<F>(handler);
+                        if (failed<F>())
+                            return;
                     }
                     else
-                        throw XMLParseException("Unexpected character", p - s);
+                        return fail<F>(XMLParseError::UnexpectedCharacter, p - s);
                 }
                 else if (*p == '?')
                 {
 
                     ++p;
                     parseProcessingInstruction<F>(handler);
+                    if (failed<F>())
+                        return;
                 }
                 else
                 {
 
                     parseElement<F>(handler);
+                    if (failed<F>())
+                        return;
                 }
             }
             else
-                throw XMLParseException("Expected <", p - s);
+                return fail<F>(XMLParseError::ExpectedLessThan, p - s);
         }
 
-        handler.endDocument();
+        callback<F>([&] { handler.endDocument(); });
+        if (F & Flag::Statistics)
+        {
+            statistics.bodyTime = std::chrono::steady_clock::now() - start;
+            statistics.bytes = p - s;
+        }
     }
+    // An Allocator limit reached, or memory the system would not give, while parsing
+    // fails the parse like malformed input
+    template <Flag F, typename H>
+    void parseLimited(char *data, H &handler)
+    {
+        try
+        {
+            parseDocument<F>(data, handler);
+        }
+        catch (const LimitExceededException &)
+        {
+            fail<F>(XMLParseError::MemoryLimitExceeded, p - s);
+        }
+        catch (const std::bad_alloc &)
+        {
+            fail<F>(XMLParseError::OutOfMemory, p - s);
+        }
+    }
+
+public:
+    // Replacement text that does not fit in situ is stored in allocator_, or in storage
+    // owned by the parser that lives until the next parse. Namespace URIs are interned in
+    // namespaces_, or in a table owned by the parser that lives as long as the parser.
+    XMLParser() : XMLParser(nullptr, nullptr) {}
+    XMLParser(Allocator &allocator_) : XMLParser(&allocator_, nullptr) {}
+    XMLParser(Allocator &allocator_, XMLNamespaceTable &namespaces_) : XMLParser(&allocator_, &namespaces_) {}
+    XMLParser(const XMLParser &src) = delete;
+
+    const Limits &getLimits() const noexcept { return limits; }
+    void setLimits(const Limits &limits_) noexcept { limits = limits_; }
+
+    // The table namespace ids reported by this parser refer to. Created by the first
+    // Flag::Namespaces parse when none was passed to the constructor.
+    XMLNamespaceTable *getNamespaces() const noexcept { return namespaces; }
+
+    template <Flag F = Flag::Default, typename H>
+    void parse(char *data, H &handler)
+    {
+        parseLimited<F>(data, handler);
+    }
+
+    // Read-only input implies Flag::NonDestructive: the buffer is never written, spans
+    // that need no decoding point into it and the rest are materialized in the allocator.
+    template <Flag F = Flag::Default, typename H>
+    void parse(const char *data, H &handler)
+    {
+        parseLimited<F | Flag::NonDestructive>(const_cast<char *>(data), handler);
+    }
+
+    // Same as parse, but reports malformed input through the result instead of throwing.
+    // The handler must not throw, other than LimitExceededException from an Allocator and
+    // std::bad_alloc, which are reported as MemoryLimitExceeded and OutOfMemory.
+    template <Flag F = Flag::Default, typename H>
+    XMLParseResult tryParse(char *data, H &handler) noexcept
+    {
+        parseLimited<F | NoThrow>(data, handler);
+        return {error, errorOffset};
+    }
+    template <Flag F = Flag::Default, typename H>
+    XMLParseResult tryParse(const char *data, H &handler) noexcept
+    {
+        parseLimited<F | Flag::NonDestructive | NoThrow>(const_cast<char *>(data), handler);
+        return {error, errorOffset};
+    }
+
+    const Statistics &getStatistics() const noexcept { return statistics; }
 };
 
 } // namespace XML
@@ -0,0 +1,272 @@
+﻿#include "printer.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <exception>
+#include <mutex>
+#include <thread>
+
+#include "../Core/file.h"
+
+NS_BEGINE
+inline namespace XML
+{
+	namespace
+	{
+		struct CountSink
+		{
+			std::uint64_t size;
+
+			void write(const char* /*data*/, std::size_t n) { size += n; }
+		};
+
+		// Buffers output and writes it to consecutive offsets of file
+		class FileSink
+		{
+		public:
+			FileSink(File& file_, std::uint64_t offset_) : file(file_), offset(offset_), buffer(std::size_t(1) << 20), size() {}
+
+			void write(const char* data, std::size_t n)
+			{
+				if (size + n > buffer.size())
+				{
+					flush();
+					if (n > buffer.size())
+					{
+						file.writeAt(data, n, offset);
+						offset += n;
+						return;
+					}
+				}
+				std::memcpy(buffer.data() + size, data, n);
+				size += n;
+			}
+			void flush()
+			{
+				if (!size)
+					return;
+				file.writeAt(buffer.data(), size, offset);
+				offset += size;
+				size = 0;
+			}
+
+		private:
+			File& file;
+			std::uint64_t offset;
+			std::vector<char> buffer;
+			std::size_t size;
+		};
+
+		// Run task(i) for every i in [0, count) on up to threads threads, the calling one
+		// included. The first exception stops the rest and is rethrown at the end.
+		template <typename T>
+		void run(std::size_t threads, std::size_t count, T task)
+		{
+			std::atomic<std::size_t> next(0);
+			std::exception_ptr exception;
+			std::mutex mutex;
+			auto work = [&]
+			{
+				try
+				{
+					for (std::size_t i; (i = next++) < count;)
+						task(i);
+				}
+				catch (...)
+				{
+					std::lock_guard<std::mutex> lock(mutex);
+					if (!exception)
+						exception = std::current_exception();
+					next = count;
+				}
+			};
+			std::vector<std::thread> pool;
+			for (std::size_t i = 1; i < std::min(threads, count); ++i)
+				pool.emplace_back(work);
+			work();
+			for (auto& thread : pool)
+				thread.join();
+			if (exception)
+				std::rethrow_exception(exception);
+		}
+
+		// Number of children of node, up to limit
+		std::size_t countChildren(const XMLNode& node, std::size_t limit) noexcept
+		{
+			std::size_t count = 0;
+			if (node.hasChildNodes())
+			{
+				for (auto child = &node.getFirstChild(); child && count < limit; child = child->next)
+					++count;
+			}
+			return count;
+		}
+	}
+
+	XMLParallelPrinter::XMLParallelPrinter(std::size_t threads_) : threads(threads_), units(), pieces(), heap(), starts()
+	{
+		if (!threads)
+			threads = std::max<std::size_t>(1, std::thread::hardware_concurrency());
+	}
+
+	void XMLParallelPrinter::cut(const XMLNode& node)
+	{
+		const auto none = static_cast<std::size_t>(-1);
+		auto target = threads * 64;
+		pieces.clear();
+		heap.clear();
+		// Make piece index the run of count siblings from first. Its weight is its length,
+		// or for a single element the number of its children, counted no further than the
+		// target; 0 cannot be split.
+		auto setNodes = [&](std::size_t index, const XMLNode* first, std::size_t count)
+		{
+			pieces[index].unit = { first, count, Part::Nodes, 0 };
+			auto weight = count > 1 ? count : first->getType() == XMLNodeType::Element ? countChildren(*first, target) : 0;
+			if (weight)
+			{
+				heap.emplace_back(weight, index);
+				std::push_heap(heap.begin(), heap.end());
+			}
+		};
+		auto insertAfter = [&](std::size_t index)
+		{
+			pieces.push_back({ Unit(), pieces[index].next });
+			pieces[index].next = pieces.size() - 1;
+			return pieces.size() - 1;
+		};
+		// Cut the siblings from first, no more than limit of them, into about parts runs of
+		// equal length, in one walk: every stride-th sibling starts a run, and the stride
+		// doubles whenever there would be more than twice the runs wanted. The first run
+		// goes to piece index, the others after it.
+		auto spread = [&](std::size_t index, const XMLNode* first, std::size_t limit, std::size_t parts)
+		{
+			starts.clear();
+			std::size_t stride = 1, count = 0;
+			for (auto child = first; child && count < limit; child = child->next, ++count)
+			{
+				if (count % stride)
+					continue;
+				starts.push_back(child);
+				if (starts.size() == 2 * parts)
+				{
+					for (std::size_t i = 0; i < parts; ++i)
+						starts[i] = starts[2 * i];
+					starts.resize(parts);
+					stride *= 2;
+				}
+			}
+			for (std::size_t i = 0; i < starts.size(); ++i)
+			{
+				if (i)
+					index = insertAfter(index);
+				setNodes(index, starts[i], std::min(stride, count - i * stride));
+			}
+		};
+
+		if (node.getType() != XMLNodeType::Document)
+		{
+			pieces.push_back({ Unit(), none });
+			setNodes(0, &node, 1);
+		}
+		else if (node.hasChildNodes())
+		{
+			pieces.push_back({ Unit(), none });
+			spread(0, &node.getFirstChild(), none, target);
+		}
+
+		// Split the heaviest unit until there are enough, never into more pieces than are
+		// still wanted, so that however wide the document is their number stays near the
+		// target and a level is walked once
+		while (pieces.size() < target && !heap.empty())
+		{
+			std::pop_heap(heap.begin(), heap.end());
+			auto index = heap.back().second;
+			heap.pop_back();
+			auto unit = pieces[index].unit;
+			auto parts = std::max<std::size_t>(2, (target - pieces.size()) / 2);
+			if (unit.count > 1)
+				spread(index, unit.node, unit.count, parts);
+			else
+			{
+				// One element: its start tag, its children and its end tag
+				pieces[index].unit.part = Part::StartTag;
+				auto children = insertAfter(index);
+				auto endTag = insertAfter(children);
+				pieces[endTag].unit = { unit.node, 1, Part::EndTag, 0 };
+				spread(children, &unit.node->getFirstChild(), none, parts);
+			}
+		}
+
+		units.clear();
+		for (auto i = pieces.empty() ? none : 0; i != none; i = pieces[i].next)
+			units.push_back(pieces[i].unit);
+	}
+
+	std::uint64_t XMLParallelPrinter::print(const XMLNode& node, const char* path)
+	{
+		auto printUnit = [](const Unit& unit, auto& sink)
+		{
+			switch (unit.part)
+			{
+			case Part::Nodes:
+			{
+				auto node = unit.node;
+				for (std::size_t i = 0; i < unit.count; ++i, node = node->next)
+					Impl::printNode(*node, sink);
+				break;
+			}
+			case Part::StartTag:
+				Impl::printStartTag(unit.node->asElement(), sink);
+				break;
+			case Part::EndTag:
+				Impl::printEndTag(unit.node->asElement(), sink);
+				break;
+			}
+		};
+
+		cut(node);
+
+		// Measure, then turn sizes into offsets
+		const std::size_t block = 256;
+		run(threads, (units.size() + block - 1) / block, [&](std::size_t i)
+		{
+			for (auto j = i * block, end = std::min(j + block, units.size()); j < end; ++j)
+			{
+				CountSink sink{ 0 };
+				printUnit(units[j], sink);
+				units[j].offset = sink.size;
+			}
+		});
+		std::uint64_t total = 0;
+		for (auto& unit : units)
+		{
+			auto size = unit.offset;
+			unit.offset = total;
+			total += size;
+		}
+
+		// Runs of units of about equal size, a few per thread
+		auto runs = threads * 8;
+		std::vector<std::size_t> starts;
+		for (std::size_t i = 0; i < units.size(); ++i)
+		{
+			if (starts.empty() || units[i].offset >= total * starts.size() / runs)
+				starts.push_back(i);
+		}
+		starts.push_back(units.size());
+
+		File file(path, File::Mode::Write);
+		file.resize(total);
+		run(threads, starts.size() - 1, [&](std::size_t i)
+		{
+			FileSink sink(file, units[starts[i]].offset);
+			for (auto j = starts[i]; j < starts[i + 1]; ++j)
+				printUnit(units[j], sink);
+			sink.flush();
+		});
+		return total;
+	}
+
+}
+NS_END
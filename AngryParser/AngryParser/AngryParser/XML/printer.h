@@ -0,0 +1,186 @@
+﻿#ifndef _PRINTER_HPP
+#define _PRINTER_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+#include <utility>
+#include <vector>
+
+#include "../Core/compilerdetection.h"
+#include "../Core/string.h"
+#include "document.h"
+
+NS_BEGINE
+inline namespace XML
+{
+
+namespace Impl
+{
+
+// Serialization shared by XMLDocument::print and XMLParallelPrinter. S provides
+// write(const char *data, std::size_t n).
+template <typename S>
+void printStartTag(const XMLElement &element, S &sink)
+{
+    auto name = element.getName();
+    sink.write("<", 1);
+    sink.write(name.getData(), name.getLength());
+    for (auto &attr : element.attribute())
+    {
+        auto attrName = attr.getName();
+        auto attrValue = attr.getValue();
+        sink.write(" ", 1);
+        sink.write(attrName.getData(), attrName.getLength());
+        sink.write("=\"", 2);
+        sink.write(attrValue.getData(), attrValue.getLength());
+        sink.write("\"", 1);
+    }
+    if (element.hasChildNodes())
+        sink.write(">", 1);
+    else
+        sink.write("/>", 2);
+}
+
+template <typename S>
+void printEndTag(const XMLElement &element, S &sink)
+{
+    auto name = element.getName();
+    sink.write("</", 2);
+    sink.write(name.getData(), name.getLength());
+    sink.write(">", 1);
+}
+
+// Any node but an element or a document
+template <typename S>
+void printLeaf(const XMLNode &node, S &sink)
+{
+    switch (node.getType())
+    {
+    case XMLNodeType::Text:
+    {
+        auto value = node.asText().getValue();
+        sink.write(value.getData(), value.getLength());
+        break;
+    }
+    case XMLNodeType::CDATA:
+    {
+        auto value = node.asCDATA().getValue();
+        sink.write("<![CDATA[", 9);
+        sink.write(value.getData(), value.getLength());
+        sink.write("]]>", 3);
+        break;
+    }
+    case XMLNodeType::Comment:
+    {
+        auto value = node.asComment().getValue();
+        sink.write("<!--", 4);
+        sink.write(value.getData(), value.getLength());
+        sink.write("-->", 3);
+        break;
+    }
+    case XMLNodeType::ProcessingInstruction:
+    {
+        auto name = node.asProcessingInstruction().getName();
+        auto value = node.asProcessingInstruction().getValue();
+        sink.write("<?", 2);
+        sink.write(name.getData(), name.getLength());
+        sink.write(" ", 1);
+        sink.write(value.getData(), value.getLength());
+        sink.write("?>", 2);
+        break;
+    }
+    default:
+        throw XMLDOMException("Invalid node type");
+    }
+}
+
+// Print top and everything below it
+template <typename S>
+void printNode(const XMLNode &top, S &sink)
+{
+    const XMLNode *cur = &top;
+    while (true)
+    {
+        if (cur->getType() == XMLNodeType::Element)
+        {
+            printStartTag(cur->asElement(), sink);
+            if (cur->hasChildNodes())
+            {
+                cur = &cur->getFirstChild();
+                continue;
+            }
+        }
+        else
+            printLeaf(*cur, sink);
+        while (cur != &top && !cur->next)
+        {
+            cur = cur->parent;
+            printEndTag(cur->asElement(), sink);
+        }
+        if (cur == &top)
+            break;
+        cur = cur->next;
+    }
+}
+
+} // namespace Impl
+
+// Writes a document to a file on several threads, byte for byte as XMLDocument::print
+// would. The document is cut into units, runs of sibling nodes with their subtrees, until
+// there are enough to share out: the heaviest run is halved, or, if it is one element,
+// opened up into its start tag, its children and its end tag. A first pass measures every
+// unit, which fixes its offset in the output; the file is then sized once, and each thread
+// serializes runs of units through a buffer of its own straight to their place in the file.
+class AngryParser_API XMLParallelPrinter
+{
+private:
+    enum class Part : std::uint8_t
+    {
+        Nodes,    // count siblings from node on, with their subtrees
+        StartTag, // of an element whose children are units of their own
+        EndTag,
+    };
+    struct Unit
+    {
+        const XMLNode *node;
+        std::size_t count;
+        Part part;
+        std::uint64_t offset;
+    };
+    // A unit while cutting: units are linked in document order, and the ones that can
+    // still be split wait in a heap by weight
+    struct Piece
+    {
+        Unit unit;
+        std::size_t next;
+    };
+
+private:
+    std::size_t threads;
+    std::vector<Unit> units;
+    std::vector<Piece> pieces;
+    std::vector<std::pair<std::size_t, std::size_t>> heap; // weight, piece
+    std::vector<const XMLNode *> starts;
+
+private:
+    void cut(const XMLNode &node);
+
+public:
+    // threads_ == 0 uses one thread per hardware thread
+    explicit XMLParallelPrinter(std::size_t threads_ = 0);
+    XMLParallelPrinter(const XMLParallelPrinter &src) = delete;
+
+    XMLParallelPrinter &operator=(const XMLParallelPrinter &src) = delete;
+
+    std::size_t getThreadCount() const noexcept { return threads; }
+
+    // Write node, a document or any node in one, to the file at path, replacing it.
+    // Returns the number of bytes written.
+    std::uint64_t print(const XMLNode &node, const char *path);
+};
+
+} // namespace XML
+NS_END
+
+#endif
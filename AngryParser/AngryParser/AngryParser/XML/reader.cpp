@@ -0,0 +1 @@
+﻿#include "reader.h"
@@ -0,0 +1,332 @@
+﻿#ifndef _READER_HPP
+#define _READER_HPP
+
+#include <cassert>
+#include <cstddef>
+
+#include <vector>
+
+#include "../Core/compilerdetection.h"
+#include "../Core/string.h"
+#include "handler.h"
+#include "parser.h"
+
+NS_BEGINE
+inline namespace XML
+{
+
+// Pull cursor over an in-situ buffer. Each next() scans exactly one token with the
+// same routines XMLParser::parse<F> uses, decoding in place, so the tokens are views
+// into data (or into the allocator, for entity replacements that do not fit). Per-token
+// work allocates nothing once the attribute and element stacks have grown to the
+// document's widest start tag and deepest nesting.
+//
+// A self-closing element is reported as StartElement with isEmptyElement() set,
+// followed by its EndElement. Errors throw XMLParseException.
+template <XMLParser::Flag F = XMLParser::Flag::Default>
+class XMLReader
+{
+    static_assert(!(F & XMLParser::Flag::Namespaces), "XMLReader does not resolve namespaces");
+
+    template <XMLParser::Flag>
+    friend class XMLStreamReader;
+    template <XMLParser::Flag>
+    friend class XMLIncrementalDocument;
+
+public:
+    enum class TokenType
+    {
+        None,
+        StartElement,
+        EndElement,
+        Text,
+        CDATA,
+        Comment,
+        ProcessingInstruction,
+        Doctype,
+        EndDocument,
+    };
+
+    struct Attribute
+    {
+        StringView name;
+        StringView value;
+    };
+    using AttributeIterator = typename std::vector<Attribute>::const_iterator;
+
+private:
+    class Handler : public XMLHandlerBase
+    {
+    public:
+        Handler(XMLReader *reader_) : reader(reader_) {}
+
+        void doctype() { reader->token = TokenType::Doctype; }
+        void attribute(StringView name, StringView value) { reader->attributeList.push_back({name, value}); }
+        void text(StringView value) { set(TokenType::Text, StringView(), value); }
+        void cdata(StringView value) { set(TokenType::CDATA, StringView(), value); }
+        void comment(StringView value) { set(TokenType::Comment, StringView(), value); }
+        void processingInstruction(StringView name, StringView value) { set(TokenType::ProcessingInstruction, name, value); }
+
+    private:
+        void set(TokenType token, StringView name, StringView value)
+        {
+            reader->token = token;
+            reader->tokenName = name;
+            reader->tokenValue = value;
+        }
+
+        XMLReader *reader;
+    };
+
+    // Flags for skipElement: nothing is decoded, but end tags are checked as in F
+    static constexpr XMLParser::Flag SkipFlags = (F & XMLParser::Flag::ClosingTagValidate) ? XMLParser::Flag::ClosingTagValidate : XMLParser::Flag::None;
+
+    XMLParser parser;
+    TokenType token;
+    StringView tokenName;
+    StringView tokenValue;
+    bool empty;
+    std::vector<Attribute> attributeList;
+    std::vector<StringView> elements;
+
+private:
+    // Scan one token outside the root element. Returns false at the end of the data.
+    bool stepDocument()
+    {
+        Handler handler(this);
+        auto &p = parser.p;
+        while (true)
+        {
+            skipChar(p, Impl::SkipCharType::Space);
+            if (!*p)
+                return false;
+            if (*p != '<')
+                parser.fail<F>(XMLParseError::ExpectedLessThan, p - parser.s);
+            ++p;
+            if (*p == '!')
+            {
+
+                ++p;
+                if (p[0] == '-' && p[1] == '-')
+                {
+
+                    p += 2;
+                    parser.parseComment<F>(handler);
+                }
+                else if (p[0] == 'D' && p[1] == 'O' && p[2] == 'C' && p[3] == 'T' && p[4] == 'Y' && p[5] == 'P' && p[6] == 'E')
+                {
+
+                    // "DOCTYPE"
+                    p += 7;
+                    parser.parseDoctype<F>(handler);
+                }
+                else
+                    parser.fail<F>(XMLParseError::UnexpectedCharacter, p - parser.s);
+            }
+            else if (*p == '?')
+            {
+
+                ++p;
+                parser.parseProcessingInstruction<F>(handler);
+            }
+            else
+                startElement<F>(handler);
+            return true;
+        }
+    }
+
+    // Scan one token inside an element
+    template <XMLParser::Flag G, typename H>
+    void stepElement(H &handler)
+    {
+        auto &p = parser.p;
+        token = TokenType::None;
+        parser.parseText<G>(handler);
+        if (token == TokenType::Text)
+            return;
+        ++p;
+        switch (*p)
+        {
+
+        case '!':
+        {
+
+            ++p;
+            if (p[0] == '-' && p[1] == '-')
+            {
+
+                p += 2;
+                parser.parseComment<G>(handler);
+            }
+            else if (p[0] == '[' && p[1] == 'C' && p[2] == 'D' && p[3] == 'A' && p[4] == 'T' && p[5] == 'A' && p[6] == '[')
+            {
+
+                // "[CDATA["
+                p += 7;
+                parser.parseCDATA<G>(handler);
+            }
+            else
+                parser.fail<G>(XMLParseError::UnexpectedCharacter, p - parser.s);
+            break;
+        }
+        case '/':
+        {
+
+            ++p;
+            XMLQualifiedName qname;
+            parser.parseEndTag<G>(handler, elements.back(), qname);
+            endElement<G>();
+            break;
+        }
+        case '?':
+        {
+
+            ++p;
+            parser.parseProcessingInstruction<G>(handler);
+            break;
+        }
+        default:
+        {
+
+            startElement<G>(handler);
+            break;
+        }
+        }
+    }
+
+    template <XMLParser::Flag G, typename H>
+    void startElement(H &handler)
+    {
+        XMLQualifiedName qname;
+        parser.parseStartTag<G>(handler, tokenName, qname, empty);
+        tokenValue = StringView();
+        token = TokenType::StartElement;
+        elements.push_back(tokenName);
+    }
+
+    template <XMLParser::Flag G>
+    void endElement()
+    {
+        tokenName = elements.back();
+        tokenValue = StringView();
+        token = TokenType::EndElement;
+        elements.pop_back();
+        --parser.depth;
+    }
+
+public:
+    // Replacement text that does not fit in situ is stored in allocator_, or in storage
+    // owned by the reader
+    XMLReader(char *data) : parser(), token(), tokenName(), tokenValue(), empty(), attributeList(), elements() { start(data); }
+    XMLReader(char *data, Allocator &allocator_) : parser(allocator_), token(), tokenName(), tokenValue(), empty(), attributeList(), elements() { start(data); }
+    // Read-only input; the reader must be instantiated with Flag::NonDestructive
+    XMLReader(const char *data) : XMLReader(const_cast<char *>(data)) { static_assert(F & XMLParser::Flag::NonDestructive, "read-only input requires Flag::NonDestructive"); }
+    XMLReader(const char *data, Allocator &allocator_) : XMLReader(const_cast<char *>(data), allocator_) { static_assert(F & XMLParser::Flag::NonDestructive, "read-only input requires Flag::NonDestructive"); }
+    XMLReader(const XMLReader &src) = delete;
+
+    XMLReader &operator=(const XMLReader &src) = delete;
+
+    // Advance to the next token. Returns false once the end of the document is reached.
+    bool next()
+    {
+        if (token == TokenType::EndDocument)
+            return false;
+        attributeList.clear();
+        if (empty)
+        {
+            empty = false;
+            endElement<F>();
+            return true;
+        }
+        if (elements.empty())
+        {
+            if (!stepDocument())
+            {
+                token = TokenType::EndDocument;
+                tokenName = tokenValue = StringView();
+                return false;
+            }
+        }
+        else
+        {
+            Handler handler(this);
+            stepElement<F>(handler);
+        }
+        return true;
+    }
+
+    // On a StartElement, move to its EndElement without decoding or reporting anything
+    // in between. Does nothing on any other token.
+    void skipElement()
+    {
+        if (token != TokenType::StartElement)
+            return;
+        attributeList.clear();
+        if (empty)
+        {
+            empty = false;
+            endElement<F>();
+            return;
+        }
+        auto depth = elements.size();
+        XMLHandlerBase handler;
+        do
+        {
+            stepElement<SkipFlags>(handler);
+            if (empty)
+            {
+                empty = false;
+                endElement<SkipFlags>();
+            }
+        } while (elements.size() >= depth);
+    }
+
+    TokenType tokenType() const noexcept { return token; }
+    // Element type or processing instruction target
+    StringView name() const noexcept { return tokenName; }
+    // Text, CDATA, comment or processing instruction content
+    StringView value() const noexcept { return tokenValue; }
+    bool isEmptyElement() const noexcept { return token == TokenType::StartElement && empty; }
+    // Number of open elements, the current StartElement included
+    std::size_t depth() const noexcept { return elements.size(); }
+    std::size_t getOffset() const noexcept { return parser.p - parser.s; }
+
+    // Attributes of the current StartElement
+    AttributeIterator beginAttributes() const noexcept { return attributeList.begin(); }
+    AttributeIterator endAttributes() const noexcept { return attributeList.end(); }
+    const std::vector<Attribute> &attributes() const noexcept { return attributeList; }
+
+    const XMLParser &getParser() const noexcept { return parser; }
+
+private:
+    void start(char *data)
+    {
+        assert(data);
+
+        parser.reset<F>(data);
+        Handler handler(this);
+        parser.parseDeclaration<F>(handler);
+    }
+    // Start over on data, another part of the same document: entities declared so far
+    // stay in effect and no XML declaration is expected
+    void resume(char *data)
+    {
+        assert(data);
+
+        parser.s = data;
+        parser.p = data;
+        parser.depth = 0;
+        parser.elementCount = 0;
+        parser.attributeCount = 0;
+        parser.reference = nullptr;
+        token = TokenType::None;
+        empty = false;
+        attributeList.clear();
+        elements.clear();
+    }
+};
+
+} // namespace XML
+NS_END
+
+#endif
@@ -0,0 +1,83 @@
+﻿#include "shared.h"
+
+#include <thread>
+
+#include "../Core/file.h"
+
+NS_BEGINE
+inline namespace XML
+{
+	XMLSharedDocument::XMLSharedDocument() : slots(), current(0), version(0), writer()
+	{
+		for (auto& slot : slots)
+		{
+			for (auto& counter : slot.counters)
+				counter.readers.store(0, std::memory_order_relaxed);
+		}
+	}
+
+	XMLSharedDocument::Pointer XMLSharedDocument::get() const noexcept
+	{
+		auto shard = getShard();
+		while (true)
+		{
+			auto i = current.load();
+			auto& readers = slots[i].counters[shard].readers;
+			readers.fetch_add(1);
+			// Still current, so a writer that switches away from it waits for us to leave
+			if (current.load() == i)
+			{
+				auto document = slots[i].document;
+				readers.fetch_sub(1, std::memory_order_release);
+				return document;
+			}
+			readers.fetch_sub(1, std::memory_order_release);
+		}
+	}
+
+	std::uint64_t XMLSharedDocument::getVersion() const noexcept
+	{
+		return version.load(std::memory_order_acquire);
+	}
+
+	std::uint64_t XMLSharedDocument::publish(Pointer document)
+	{
+		std::lock_guard<std::mutex> lock(writer);
+		auto i = current.load(std::memory_order_relaxed);
+		// Readers that saw the spare slot as current before the last switch may still be in it
+		auto& next = slots[i ^ 1];
+		drain(next);
+		next.document = std::move(document);
+		current.store(i ^ 1);
+		drain(slots[i]);
+		slots[i].document.reset();
+		auto number = version.load(std::memory_order_relaxed) + 1;
+		version.store(number, std::memory_order_release);
+		return number;
+	}
+
+	std::size_t XMLSharedDocument::getShard() noexcept
+	{
+		static std::atomic<std::size_t> threads(0);
+		thread_local std::size_t shard = threads.fetch_add(1, std::memory_order_relaxed) % Shards;
+		return shard;
+	}
+
+	void XMLSharedDocument::drain(Slot& slot) noexcept
+	{
+		for (auto& counter : slot.counters)
+		{
+			while (counter.readers.load())
+				std::this_thread::yield();
+		}
+	}
+
+	std::vector<char> XMLSharedDocument::readFile(const char* path)
+	{
+		File file(path, File::Mode::Read);
+		std::vector<char> data(static_cast<std::size_t>(file.getSize()));
+		data.resize(data.empty() ? 0 : file.readAt(data.data(), data.size(), 0));
+		return data;
+	}
+}
+NS_END
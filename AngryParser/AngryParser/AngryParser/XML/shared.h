@@ -0,0 +1,121 @@
+﻿#ifndef _SHARED_HPP
+#define _SHARED_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+#include <atomic>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "../Core/compilerdetection.h"
+#include "document.h"
+
+NS_BEGINE
+inline namespace XML
+{
+
+// Immutable document read by many threads and replaced now and then. get() returns the
+// current version without taking a lock; a reload parses into a new document, off the
+// readers' path, and publishes it with one atomic store. A version is freed once it has
+// been replaced and the last pointer to it is released.
+//
+// The current document sits in one of two slots. A reader announces itself on a counter
+// of that slot (one of several, picked per thread, so that readers do not all contend
+// for one cache line), checks that the slot is still current and copies its pointer. A
+// writer fills the other slot only once its counters are zero, switches to it, and waits
+// for the counters of the old one to drain before dropping its pointer. Readers never
+// wait; writers are serialized and wait only for readers inside those few instructions.
+class AngryParser_API XMLSharedDocument
+{
+public:
+    using Pointer = std::shared_ptr<const XMLDocument>;
+
+private:
+    static constexpr std::size_t Shards = 16;
+
+    // Padded to a cache line of its own
+    struct Counter
+    {
+        std::atomic<std::size_t> readers;
+        char padding[64 - sizeof(std::atomic<std::size_t>)];
+    };
+    struct Slot
+    {
+        Counter counters[Shards];
+        Pointer document;
+    };
+    // A parsed document with the buffer it refers into
+    struct Snapshot
+    {
+        std::vector<char> data;
+        XMLDocument document;
+    };
+
+private:
+    mutable Slot slots[2];
+    std::atomic<std::size_t> current;
+    std::atomic<std::uint64_t> version;
+    std::mutex writer;
+
+private:
+    static std::size_t getShard() noexcept;
+    static std::vector<char> readFile(const char *path);
+    static void drain(Slot &slot) noexcept;
+
+    template <XMLParser::Flag F>
+    static Pointer build(std::vector<char> &&data)
+    {
+        auto snapshot = std::make_shared<Snapshot>();
+        snapshot->data = std::move(data);
+        snapshot->data.push_back(0);
+        snapshot->document.presize(snapshot->data.data(), snapshot->data.size() - 1);
+        snapshot->document.template parse<F>(snapshot->data.data());
+        return Pointer(snapshot, &snapshot->document);
+    }
+
+public:
+    XMLSharedDocument();
+    XMLSharedDocument(const XMLSharedDocument &src) = delete;
+    ~XMLSharedDocument() = default;
+
+    XMLSharedDocument &operator=(const XMLSharedDocument &src) = delete;
+
+    // The current version, or null before the first one is published. Lock-free.
+    Pointer get() const noexcept;
+    // Number of versions published so far; the one get() returns if nothing is published meanwhile
+    std::uint64_t getVersion() const noexcept;
+
+    // Make document the current version and return its number
+    std::uint64_t publish(Pointer document);
+
+    // Parse a private copy of data[0, length), or the file at path, and publish it. A
+    // document that does not parse throws and leaves the current version in place.
+    template <XMLParser::Flag F = XMLParser::Flag::Default>
+    std::uint64_t load(const char *data, std::size_t length)
+    {
+        return publish(build<F>(std::vector<char>(data, data + length)));
+    }
+    template <XMLParser::Flag F = XMLParser::Flag::Default>
+    std::uint64_t loadFile(const char *path)
+    {
+        return publish(build<F>(readFile(path)));
+    }
+
+    // loadFile on a thread of its own. The future yields the new version number, or the
+    // exception that kept it from being published.
+    template <XMLParser::Flag F = XMLParser::Flag::Default>
+    std::future<std::uint64_t> reload(std::string path)
+    {
+        return std::async(std::launch::async, [this](const std::string &path_) { return loadFile<F>(path_.c_str()); }, std::move(path));
+    }
+};
+
+} // namespace XML
+NS_END
+
+#endif
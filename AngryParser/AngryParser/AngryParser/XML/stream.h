@@ -0,0 +1,324 @@
+﻿#ifndef _STREAM_HPP
+#define _STREAM_HPP
+
+#include <cassert>
+#include <cstddef>
+#include <cstring>
+
+#include <algorithm>
+#include <vector>
+
+#include "../Core/compilerdetection.h"
+#include "../Core/allocator.h"
+#include "../Core/string.h"
+#include "reader.h"
+
+NS_BEGINE
+inline namespace XML
+{
+
+// Incremental front-end for XMLReader. Input arrives in chunks through prepare() and
+// commit() (or append()), followed by finish() at the end of the input. next() hands
+// a token to the reader only once the token lies entirely in the buffer, and returns
+// NeedData otherwise, so the reader never sees a token cut at a chunk boundary.
+//
+// Only the unconsumed tail is kept: when more room is needed the parsed prefix is
+// dropped and the tail moved to the front. Names of open elements and DOCTYPE entity
+// declarations that live in the dropped prefix are first copied into storage owned by
+// the stream. Tokens are valid until the next call to next() or prepare().
+template <XMLParser::Flag F = XMLParser::Flag::Default>
+class XMLStreamReader
+{
+public:
+    enum class Status
+    {
+        Token,
+        NeedData,
+        End,
+    };
+    using TokenType = typename XMLReader<F>::TokenType;
+    using Attribute = typename XMLReader<F>::Attribute;
+
+private:
+    std::vector<char> buffer; // [0, size) holds data, buffer[size] is always 0
+    std::size_t size;
+    std::size_t consumed;     // bytes dropped from the front of the stream so far
+    std::size_t resume;       // where the last unsuccessful delimiter search stopped,
+    std::size_t resumeFrom;   // where it started
+    char resumeKey;           // and the first character of its delimiter
+    bool eof;
+    bool started;
+    Allocator storage;
+    XMLReader<F> reader;
+
+private:
+    char *begin() noexcept { return buffer.data(); }
+    char *end() noexcept { return buffer.data() + size; }
+
+    // Find the delimiter d in [from, end()). A search repeated after more data arrived
+    // resumes where it stopped, so a token split over many chunks is scanned once.
+    char *search(char *from, const char *d, std::size_t length) noexcept
+    {
+        auto start = static_cast<std::size_t>(from - begin());
+        auto q = from;
+        if (resumeFrom == start && resumeKey == d[0] && resume > start + length)
+            q = begin() + resume - length;
+        while (auto found = static_cast<char *>(std::memchr(q, d[0], end() - q)))
+        {
+            if (static_cast<std::size_t>(end() - found) < length)
+                break;
+            if (!std::memcmp(found, d, length))
+                return found;
+            q = found + 1;
+        }
+        resume = size;
+        resumeFrom = start;
+        resumeKey = d[0];
+        return nullptr;
+    }
+    char *search(char *from, char c) noexcept { return search(from, &c, 1); }
+    // 1 if [q, end()) starts with prefix, 0 if it cannot, -1 if there is not enough data yet
+    int startsWith(const char *q, const char *prefix, std::size_t length) const noexcept
+    {
+        auto n = std::min<std::size_t>(length, buffer.data() + size - q);
+        if (std::memcmp(q, prefix, n))
+            return 0;
+        return n == length ? 1 : -1;
+    }
+
+    bool declarationAvailable()
+    {
+        auto q = begin();
+        switch (startsWith(q, "\xEF\xBB\xBF", 3))
+        {
+        case 1:
+            q += 3;
+            break;
+        case -1:
+            return eof;
+        default:
+            break;
+        }
+        switch (startsWith(q, "<?xml", 5))
+        {
+        case 1:
+            return eof || search(q + 5, "?>", 2);
+        case -1:
+            return eof;
+        default:
+            return true;
+        }
+    }
+
+    // Whether the markup starting at t is complete
+    bool markupAvailable(char *t)
+    {
+        if (end() - t < 2)
+            return eof;
+        switch (t[1])
+        {
+        case '!':
+        {
+            int m;
+            if ((m = startsWith(t, "<!--", 4)) == 1)
+                return search(t + 4, "-->", 3) || eof;
+            if (m == -1)
+                return eof;
+            if ((m = startsWith(t, "<![CDATA[", 9)) == 1)
+                return search(t + 9, "]]>", 3) || eof;
+            if (m == -1)
+                return eof;
+            if ((m = startsWith(t, "<!DOCTYPE", 9)) == 1)
+                return doctypeAvailable(t + 9) || eof;
+            return m == -1 ? eof : true;
+        }
+        case '?':
+            return search(t + 2, "?>", 2) || eof;
+        case '/':
+            return search(t + 2, '>') || eof;
+        default:
+        {
+            // Start tag; '>' may appear inside attribute values
+            char quote = 0;
+            for (auto q = t + 1, e = end(); q != e; ++q)
+            {
+                if (quote)
+                {
+                    if (*q == quote)
+                        quote = 0;
+                }
+                else if (*q == '"' || *q == '\'')
+                    quote = *q;
+                else if (*q == '>')
+                    return true;
+            }
+            return eof;
+        }
+        }
+    }
+
+    bool doctypeAvailable(char *q)
+    {
+        char quote = 0;
+        bool subset = false;
+        for (auto e = end(); q != e; ++q)
+        {
+            if (quote)
+            {
+                if (*q == quote)
+                    quote = 0;
+            }
+            else if (*q == '"' || *q == '\'')
+                quote = *q;
+            else if (subset && startsWith(q, "<!--", 4) == 1)
+            {
+                q = search(q + 4, "-->", 3);
+                if (!q)
+                    return false;
+                q += 2;
+            }
+            else if (*q == '[')
+                subset = true;
+            else if (*q == ']')
+                subset = false;
+            else if (*q == '>' && !subset)
+                return true;
+        }
+        return false;
+    }
+
+    // Whether the next token lies entirely in the buffer
+    bool available()
+    {
+        auto q = reader.parser.p;
+        if (!reader.elements.empty())
+        {
+            auto t = search(q, '<');
+            if (!t)
+                return eof;
+            if (F & XMLParser::Flag::TrimSpace)
+            {
+                while (q != t && (*q == ' ' || *q == '\t' || *q == '\n' || *q == '\r'))
+                    ++q;
+            }
+            return q != t || markupAvailable(t);
+        }
+        while (q != end() && (*q == ' ' || *q == '\t' || *q == '\n' || *q == '\r'))
+            ++q;
+        if (q == end())
+            return eof;
+        return *q != '<' || markupAvailable(q);
+    }
+
+    // Drop the parsed prefix, moving the tail to the front of a buffer with room for n more bytes
+    void rebase(std::size_t n)
+    {
+        auto offset = started ? static_cast<std::size_t>(reader.parser.p - begin()) : 0;
+        auto live = size - offset;
+        auto prefix = begin(), parsed = begin() + offset;
+        for (auto &name : reader.elements)
+        {
+            if (name.getData() >= prefix && name.getData() < parsed)
+                name = copy(name);
+        }
+        reader.parser.entities.relocate(prefix, parsed, storage);
+
+        if (live + n + 1 <= buffer.size())
+            std::memmove(begin(), parsed, live);
+        else
+        {
+            std::vector<char> next(std::max(buffer.size() * 2, live + n + 1));
+            std::memcpy(next.data(), parsed, live);
+            buffer.swap(next);
+        }
+        size = live;
+        buffer[size] = 0;
+        consumed += offset;
+        if (resumeFrom >= offset)
+            resume -= offset, resumeFrom -= offset;
+        else
+            resume = resumeFrom = 0, resumeKey = 0;
+        if (started)
+        {
+            auto &parser = reader.parser;
+            parser.s = parser.p = begin();
+            // p - s restarts from zero; keep the amplification budget of the dropped bytes
+            auto credit = parser.limits.entityAmplification * offset;
+            parser.expanded = parser.expanded > credit ? parser.expanded - credit : 0;
+        }
+    }
+
+    StringView copy(StringView value)
+    {
+        auto data = static_cast<char *>(storage.allocate(value.getLength() + 1, 1));
+        std::copy(value.begin(), value.end(), data);
+        data[value.getLength()] = 0;
+        return StringView(data, value.getLength());
+    }
+
+public:
+    XMLStreamReader() : buffer(1), size(), consumed(), resume(), resumeFrom(), resumeKey(), eof(), started(), storage(), reader(buffer.data()) {}
+    XMLStreamReader(const XMLStreamReader &src) = delete;
+
+    XMLStreamReader &operator=(const XMLStreamReader &src) = delete;
+
+    // Room for at least n bytes at the end of the input; commit(k) appends the first k of them
+    char *prepare(std::size_t n)
+    {
+        assert(!eof);
+
+        if (size + n + 1 > buffer.size())
+            rebase(n);
+        return end();
+    }
+    void commit(std::size_t n) noexcept
+    {
+        assert(size + n < buffer.size());
+
+        size += n;
+        buffer[size] = 0;
+    }
+    void append(const char *data, std::size_t n)
+    {
+        std::memcpy(prepare(n), data, n);
+        commit(n);
+    }
+    // No more input follows; whatever is left is parsed as is
+    void finish() noexcept { eof = true; }
+
+    Status next()
+    {
+        if (reader.token == TokenType::EndDocument)
+            return Status::End;
+        if (!started)
+        {
+            if (!declarationAvailable())
+                return Status::NeedData;
+            started = true;
+            resumeKey = 0;
+            reader.start(begin());
+        }
+        if (!reader.empty && !available())
+            return Status::NeedData;
+        resumeKey = 0;
+        return reader.next() ? Status::Token : Status::End;
+    }
+
+    TokenType tokenType() const noexcept { return reader.tokenType(); }
+    StringView name() const noexcept { return reader.name(); }
+    StringView value() const noexcept { return reader.value(); }
+    bool isEmptyElement() const noexcept { return reader.isEmptyElement(); }
+    std::size_t depth() const noexcept { return reader.depth(); }
+    const std::vector<Attribute> &attributes() const noexcept { return reader.attributes(); }
+
+    // Offset of the cursor from the start of the stream. XMLParseException offsets count
+    // from the start of the buffered data, which begins getConsumed() bytes into the stream.
+    std::size_t getOffset() const noexcept { return consumed + (started ? reader.getOffset() : 0); }
+    std::size_t getConsumed() const noexcept { return consumed; }
+    std::size_t getBufferSize() const noexcept { return buffer.size(); }
+};
+
+} // namespace XML
+NS_END
+
+#endif
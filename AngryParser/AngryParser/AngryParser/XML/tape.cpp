@@ -0,0 +1,58 @@
+﻿#include "tape.h"
+
+NS_BEGINE
+inline namespace XML
+{
+	StringView XMLTapeCursor::getAttribute(StringView name) const noexcept
+	{
+		for (auto attribute = getAttributes(); attribute; attribute.next())
+		{
+			if (attribute.getName() == name)
+				return attribute.getValue();
+		}
+		return StringView();
+	}
+
+	XMLTapeCursor XMLTapeCursor::getChild(StringView name) const noexcept
+	{
+		auto child = getChildren();
+		if (child && (child.getType() != XMLTapeType::Element || child.getName() != name))
+			child.nextElement(name);
+		return child;
+	}
+
+	bool XMLTapeCursor::nextElement(StringView name) noexcept
+	{
+		while (next())
+		{
+			if (getType() == XMLTapeType::Element && getName() == name)
+				return true;
+		}
+		return false;
+	}
+
+	XMLTapeCursor XMLTape::getRootElement() const noexcept
+	{
+		for (auto node = getTop(); node; node.next())
+		{
+			if (node.getType() == XMLTapeType::Element)
+				return node;
+		}
+		return XMLTapeCursor();
+	}
+
+	void XMLTape::clear()
+	{
+		std::vector<XMLTapeEntry>().swap(entries);
+		std::vector<std::uint32_t>().swap(elements);
+		allocator.clear();
+	}
+
+	void XMLTape::reset() noexcept
+	{
+		entries.clear();
+		elements.clear();
+		allocator.reset();
+	}
+}
+NS_END
@@ -0,0 +1,258 @@
+﻿#ifndef _TAPE_HPP
+#define _TAPE_HPP
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+
+#include <vector>
+
+#include "../Core/compilerdetection.h"
+#include "../Core/allocator.h"
+#include "../Core/exception.h"
+#include "../Core/string.h"
+#include "handler.h"
+#include "parser.h"
+
+NS_BEGINE
+inline namespace XML
+{
+
+enum class XMLTapeType : std::uint32_t
+{
+    Element,
+    Attribute,
+    Text,
+    CDATA,
+    Comment,
+    ProcessingInstruction,
+};
+
+// One node of a tape, 32 bytes. An element is followed by its attributes and then by its
+// content in document order, and next is the index just past all of them.
+class XMLTapeEntry
+{
+    friend class XMLTape;
+
+private:
+    const char *name;
+    const char *value;
+    std::uint32_t nameLength;
+    std::uint32_t valueLength; // for an element, the number of attributes
+    std::uint32_t next;
+    XMLTapeType type;
+
+public:
+    XMLTapeType getType() const noexcept { return type; }
+    // Element, attribute or processing instruction target, as written
+    StringView getName() const noexcept { return StringView(name, nameLength); }
+    // Value of anything but an element
+    StringView getValue() const noexcept { return type == XMLTapeType::Element ? StringView() : StringView(value, valueLength); }
+    std::size_t getAttributeCount() const noexcept { return type == XMLTapeType::Element ? valueLength : 0; }
+    // Index of the entry after this one and everything it contains
+    std::size_t getNext() const noexcept { return next; }
+};
+
+// Position among the siblings of one parent, or among its attributes; copied by value.
+// Moving on and skipping a subtree are both one step.
+class AngryParser_API XMLTapeCursor
+{
+private:
+    const XMLTapeEntry *tape;
+    std::size_t index;
+    std::size_t end; // where the siblings end
+
+public:
+    XMLTapeCursor() noexcept : tape(), index(), end() {}
+    XMLTapeCursor(const XMLTapeEntry *tape_, std::size_t index_, std::size_t end_) noexcept : tape(tape_), index(index_), end(end_) {}
+
+    explicit operator bool() const noexcept { return index < end; }
+    const XMLTapeEntry &operator*() const noexcept { return tape[index]; }
+    const XMLTapeEntry *operator->() const noexcept { return tape + index; }
+    std::size_t getIndex() const noexcept { return index; }
+
+    XMLTapeType getType() const noexcept { return tape[index].getType(); }
+    StringView getName() const noexcept { return tape[index].getName(); }
+    StringView getValue() const noexcept { return tape[index].getValue(); }
+
+    // Move to the next sibling, past the subtree of this one; false if there is none
+    bool next() noexcept
+    {
+        assert(index < end);
+        index = tape[index].getNext();
+        return index < end;
+    }
+    // Cursors over the attributes and the content of an element, empty if there are none
+    XMLTapeCursor getAttributes() const noexcept
+    {
+        auto first = index + 1;
+        return XMLTapeCursor(tape, first, first + tape[index].getAttributeCount());
+    }
+    XMLTapeCursor getChildren() const noexcept
+    {
+        return XMLTapeCursor(tape, index + 1 + tape[index].getAttributeCount(), tape[index].getNext());
+    }
+
+    // Value of the attribute called name, or a null view if the element has none
+    StringView getAttribute(StringView name) const noexcept;
+    // First child element called name, or an empty cursor
+    XMLTapeCursor getChild(StringView name) const noexcept;
+    // Move to the next sibling element called name; false if there is none
+    bool nextElement(StringView name) noexcept;
+};
+
+// Read-only document stored as a flat array of nodes in document order, written by the
+// parser as it goes instead of a linked XMLNode tree. A walk of the whole document is a
+// scan of one array, and a subtree is skipped by jumping to its next index. Names and
+// values point into the parsed buffer, or into the tape's arena where they had to be
+// decoded out of place, and stay valid until the next parse. Namespaces are not resolved.
+class AngryParser_API XMLTape
+{
+private:
+    class Handler : public XMLHandlerBase
+    {
+    public:
+        explicit Handler(XMLTape &tape_) : tape(tape_) {}
+
+        void startElement(StringView name) { tape.openElement(name); }
+        void startElementNS(const XMLQualifiedName &name) { tape.openElement(name.name); }
+        void endElement(StringView /*name*/) { tape.closeElement(); }
+        void endElementNS(const XMLQualifiedName & /*name*/) { tape.closeElement(); }
+        void endAttributes(bool empty)
+        {
+            if (empty)
+                tape.closeElement();
+        }
+        void attribute(StringView name, StringView value) { tape.pushAttribute(name, value); }
+        void attributeNS(const XMLQualifiedName &name, StringView value) { tape.pushAttribute(name.name, value); }
+        void text(StringView value) { tape.push(XMLTapeType::Text, StringView(), value); }
+        void cdata(StringView value) { tape.push(XMLTapeType::CDATA, StringView(), value); }
+        void comment(StringView value) { tape.push(XMLTapeType::Comment, StringView(), value); }
+        void processingInstruction(StringView name, StringView value) { tape.push(XMLTapeType::ProcessingInstruction, name, value); }
+
+    private:
+        XMLTape &tape;
+    };
+
+private:
+    std::vector<XMLTapeEntry> entries;
+    std::vector<std::uint32_t> elements; // indices of elements whose end has not been seen
+    Allocator allocator;
+    XMLParser::Limits limits;
+
+private:
+    void reset() noexcept;
+
+    // Indices and lengths are 32-bit: a tape past 2^32 - 1 entries, or a name or value of
+    // 4 GiB or more, is over its limit. The parser reports that as MemoryLimitExceeded, and
+    // std::bad_alloc from the vectors as OutOfMemory, at the node being pushed.
+    void push(XMLTapeType type, StringView name, StringView value)
+    {
+        if (entries.size() >= UINT32_MAX || name.getLength() > UINT32_MAX || value.getLength() > UINT32_MAX)
+            throw LimitExceededException();
+        XMLTapeEntry entry;
+        entry.name = name.getData();
+        entry.value = value.getData();
+        entry.nameLength = static_cast<std::uint32_t>(name.getLength());
+        entry.valueLength = static_cast<std::uint32_t>(value.getLength());
+        entry.next = static_cast<std::uint32_t>(entries.size() + 1);
+        entry.type = type;
+        entries.push_back(entry);
+    }
+    // Each step leaves the tape whole if the next one throws, so that a failed tryParse
+    // can still close what is open
+    void openElement(StringView name)
+    {
+        push(XMLTapeType::Element, name, StringView());
+        elements.push_back(static_cast<std::uint32_t>(entries.size() - 1));
+    }
+    void pushAttribute(StringView name, StringView value)
+    {
+        push(XMLTapeType::Attribute, name, value);
+        ++entries[elements.back()].valueLength;
+    }
+    void closeElement() noexcept
+    {
+        entries[elements.back()].next = static_cast<std::uint32_t>(entries.size());
+        elements.pop_back();
+    }
+
+public:
+    XMLTape() : entries(), elements(), allocator(), limits() {}
+    XMLTape(const XMLTape &src) = delete;
+
+    XMLTape &operator=(const XMLTape &src) = delete;
+
+    // Room for count entries, so that a parse of about that many nodes does not grow the tape
+    void reserve(std::size_t count) { entries.reserve(count); }
+    void clear();
+
+    const XMLParser::Limits &getLimits() const noexcept { return limits; }
+    void setLimits(const XMLParser::Limits &limits_) noexcept { limits = limits_; }
+
+    std::size_t getSize() const noexcept { return entries.size(); }
+    const XMLTapeEntry &operator[](std::size_t index) const noexcept { return entries[index]; }
+    const XMLTapeEntry *begin() const noexcept { return entries.data(); }
+    const XMLTapeEntry *end() const noexcept { return entries.data() + entries.size(); }
+
+    // Cursor over the top level: the root element and any comments and processing
+    // instructions around it
+    XMLTapeCursor getTop() const noexcept { return XMLTapeCursor(entries.data(), 0, entries.size()); }
+    // The root element, or an empty cursor if nothing has been parsed
+    XMLTapeCursor getRootElement() const noexcept;
+
+    // The tape is 32-bit indexed, so a document may hold up to 2^32 - 1 nodes; see push
+    template <XMLParser::Flag F = XMLParser::Flag::Default>
+    void parse(char *data)
+    {
+        reset();
+        XMLParser parser(allocator);
+        parser.setLimits(limits);
+        Handler handler(*this);
+        parser.parse<F>(data, handler);
+    }
+    // Read-only input, parsed with XMLParser::Flag::NonDestructive. The tape refers into
+    // data, which must outlive it.
+    template <XMLParser::Flag F = XMLParser::Flag::Default>
+    void parse(const char *data)
+    {
+        reset();
+        XMLParser parser(allocator);
+        parser.setLimits(limits);
+        Handler handler(*this);
+        parser.parse<F>(data, handler);
+    }
+
+    // Exception-free parse; on failure, including a full tape or no memory for it, the tape
+    // holds what came before the error, with elements that were still open ending at the
+    // last entry
+    template <XMLParser::Flag F = XMLParser::Flag::Default>
+    XMLParseResult tryParse(char *data) noexcept
+    {
+        reset();
+        XMLParser parser(allocator);
+        parser.setLimits(limits);
+        Handler handler(*this);
+        auto result = parser.tryParse<F>(data, handler);
+        while (!elements.empty())
+            closeElement();
+        return result;
+    }
+    template <XMLParser::Flag F = XMLParser::Flag::Default>
+    XMLParseResult tryParse(const char *data) noexcept
+    {
+        reset();
+        XMLParser parser(allocator);
+        parser.setLimits(limits);
+        Handler handler(*this);
+        auto result = parser.tryParse<F>(data, handler);
+        while (!elements.empty())
+            closeElement();
+        return result;
+    }
+};
+
+} // namespace XML
+NS_END
+
+#endif
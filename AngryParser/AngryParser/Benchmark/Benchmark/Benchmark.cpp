@@ -0,0 +1,358 @@
+﻿#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <ostream>
+#include <streambuf>
+#include <string>
+#include <vector>
+
+#include "XML/document.h"
+
+using namespace AngryParser;
+
+// Synthetic corpus benchmark.
+// Every run prints one JSON object per line:
+// {"shape":"wide","bytes":1048576,"mode":"sax","flags":"TrimSpace|EntityTranslation",...}
+
+using Flag = XML::XMLParser::Flag;
+
+enum class Shape
+{
+	Deep,
+	Wide,
+	Attribute,
+	Text,
+	Entity,
+	CDATA,
+};
+
+const char* const shapeNames[] = { "deep", "wide", "attribute", "text", "entity", "cdata" };
+
+struct Options
+{
+	std::vector<Shape> shapes;
+	std::vector<std::size_t> sizes;
+	std::size_t iterations = 0;
+	std::size_t depth = 256;
+};
+
+std::string generate(Shape shape, std::size_t size, std::size_t depth)
+{
+	std::string s;
+	s.reserve(size + 4096);
+	s += "<?xml version=\"1.0\" encoding=\"utf-8\"?>\n<root>\n";
+	std::size_t n = 0;
+	while (s.size() < size)
+	{
+		auto id = std::to_string(n++);
+		switch (shape)
+		{
+		case Shape::Deep:
+		{
+			for (std::size_t i = 0; i < depth; ++i)
+				s += "<d>";
+			s += id;
+			for (std::size_t i = 0; i < depth; ++i)
+				s += "</d>";
+			s += '\n';
+			break;
+		}
+		case Shape::Wide:
+		{
+			s += "\t<item id=\"" + id + "\"/>\n";
+			break;
+		}
+		case Shape::Attribute:
+		{
+			s += "\t<node";
+			for (int i = 0; i < 16; ++i)
+				s += " a" + std::to_string(i) + "=\"" + id + "-" + std::to_string(i) + "\"";
+			s += "/>\n";
+			break;
+		}
+		case Shape::Text:
+		{
+			s += "\t<p>Lorem ipsum dolor sit amet, consectetur adipiscing elit, sed do eiusmod tempor\n"
+				"\t\tincididunt ut labore et dolore magna aliqua.   Ut enim ad minim veniam " + id + "</p>\n";
+			break;
+		}
+		case Shape::Entity:
+		{
+			s += "\t<e k=\"&lt;" + id + "&gt;\">&amp;&lt;&gt;&quot;&apos; &#65;&#x42; " + id + " &amp;amp;</e>\n";
+			break;
+		}
+		case Shape::CDATA:
+		{
+			s += "\t<c><![CDATA[<not> & markup ";
+			s.append(200, 'x');
+			s += id + "]]></c>\n";
+			break;
+		}
+		}
+	}
+	s += "</root>\n";
+	return s;
+}
+
+class NullHandler : public XML::XMLHandlerBase
+{
+};
+
+class CountHandler : public XML::XMLHandlerBase
+{
+public:
+	std::size_t nodes = 0;
+
+	void startElement(StringView /*name*/) { ++nodes; }
+	void attribute(StringView /*name*/, StringView /*value*/) { ++nodes; }
+	void text(StringView /*value*/) { ++nodes; }
+	void cdata(StringView /*value*/) { ++nodes; }
+	void comment(StringView /*value*/) { ++nodes; }
+	void processingInstruction(StringView /*name*/, StringView /*value*/) { ++nodes; }
+};
+
+class CountBuffer : public std::streambuf
+{
+public:
+	std::size_t count = 0;
+
+protected:
+	int_type overflow(int_type c) override
+	{
+		++count;
+		return traits_type::not_eof(c);
+	}
+	std::streamsize xsputn(const char* /*s*/, std::streamsize n) override
+	{
+		count += static_cast<std::size_t>(n);
+		return n;
+	}
+};
+
+std::string flagName(Flag f)
+{
+	std::string name;
+	auto add = [&](Flag g, const char* s)
+	{
+		if (f & g)
+		{
+			if (!name.empty()) name += '|';
+			name += s;
+		}
+	};
+	add(Flag::TrimSpace, "TrimSpace");
+	add(Flag::NormalizeSpace, "NormalizeSpace");
+	add(Flag::EntityTranslation, "EntityTranslation");
+	add(Flag::ClosingTagValidate, "ClosingTagValidate");
+	return name.empty() ? "None" : name;
+}
+
+struct Result
+{
+	double seconds = 0;
+	std::size_t iterations = 0;
+	std::size_t memory = 0; // most held by one run: the input buffer and what it parsed into
+	std::string error;
+};
+
+void report(const char* shape, std::size_t bytes, std::size_t nodes, const char* mode, Flag f, const Result& result)
+{
+	std::cout << "{\"shape\":\"" << shape << "\",\"bytes\":" << bytes << ",\"nodes\":" << nodes
+		<< ",\"mode\":\"" << mode << "\",\"flags\":\"" << flagName(f) << "\"";
+	if (!result.error.empty())
+		std::cout << ",\"error\":\"" << result.error << "\"";
+	else
+	{
+		double perRun = result.seconds / result.iterations;
+		std::cout << ",\"iterations\":" << result.iterations << ",\"seconds\":" << perRun
+			<< ",\"mb_per_s\":" << bytes / perRun / 1e6 << ",\"nodes_per_s\":" << nodes / perRun;
+	}
+	std::cout << ",\"peak_memory\":" << result.memory << "}" << std::endl;
+}
+
+// Times body(buffer) on a fresh copy of corpus for each iteration, since parsing is in situ.
+// Copies are excluded from the measurement. body returns the bytes its arena reserved, so
+// that each mode reports its own memory rather than the process high-water mark.
+template <typename B>
+Result measure(const std::string& corpus, std::size_t iterations, B body)
+{
+	Result result;
+	std::vector<char> buffer(corpus.size() + 1);
+	try
+	{
+		while (true)
+		{
+			std::memcpy(buffer.data(), corpus.c_str(), corpus.size() + 1);
+			auto start = std::chrono::steady_clock::now();
+			auto held = body(buffer.data());
+			auto stop = std::chrono::steady_clock::now();
+			result.memory = std::max(result.memory, buffer.size() + held);
+			result.seconds += std::chrono::duration<double>(stop - start).count();
+			++result.iterations;
+			// Without an explicit count, run for at least half a second
+			if (iterations ? result.iterations >= iterations : result.seconds >= 0.5)
+				break;
+		}
+	}
+	catch (const std::exception& e)
+	{
+		result.error = e.what();
+		if (result.error.empty()) result.error = "exception";
+	}
+	return result;
+}
+
+template <std::uint32_t I>
+void runFlags(const char* shape, const std::string& corpus, std::size_t nodes, const Options& options)
+{
+	constexpr Flag F = static_cast<Flag>(I);
+
+	report(shape, corpus.size(), nodes, "sax", F, measure(corpus, options.iterations, [](char* data)
+	{
+		Allocator allocator;
+		XML::XMLParser parser(allocator);
+		NullHandler handler;
+		parser.parse<F>(data, handler);
+		return allocator.getReservedSize();
+	}));
+
+	report(shape, corpus.size(), nodes, "dom", F, measure(corpus, options.iterations, [](char* data)
+	{
+		XML::XMLDocument document;
+		document.parse<F>(data);
+		return document.getArenaReserved();
+	}));
+
+	{
+		std::vector<char> buffer(corpus.begin(), corpus.end());
+		buffer.push_back(0);
+		XML::XMLDocument document;
+		Result result;
+		try
+		{
+			document.parse<F>(buffer.data());
+			result = measure(corpus, options.iterations, [&](char* /*data*/)
+			{
+				CountBuffer sink;
+				std::ostream stream(&sink);
+				document.print(stream);
+				return document.getArenaReserved();
+			});
+		}
+		catch (const std::exception& e)
+		{
+			result.error = e.what();
+			if (result.error.empty()) result.error = "exception";
+		}
+		report(shape, corpus.size(), nodes, "print", F, result);
+	}
+}
+
+template <std::uint32_t... I>
+struct FlagRunner;
+
+template <>
+struct FlagRunner<>
+{
+	static void run(const char*, const std::string&, std::size_t, const Options&) {}
+};
+
+template <std::uint32_t I, std::uint32_t... Rest>
+struct FlagRunner<I, Rest...>
+{
+	static void run(const char* shape, const std::string& corpus, std::size_t nodes, const Options& options)
+	{
+		runFlags<I>(shape, corpus, nodes, options);
+		FlagRunner<Rest...>::run(shape, corpus, nodes, options);
+	}
+};
+
+// Every combination of TrimSpace, NormalizeSpace, EntityTranslation and ClosingTagValidate
+using AllFlags = FlagRunner<0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15>;
+
+std::size_t parseSize(const char* s)
+{
+	char* end;
+	double v = std::strtod(s, &end);
+	switch (*end)
+	{
+	case 'k': case 'K': v *= 1024; break;
+	case 'm': case 'M': v *= 1024 * 1024; break;
+	case 'g': case 'G': v *= 1024.0 * 1024 * 1024; break;
+	default: break;
+	}
+	return static_cast<std::size_t>(v);
+}
+
+void usage()
+{
+	std::cerr << "Usage: Benchmark [--shape deep|wide|attribute|text|entity|cdata]... [--size N[K|M|G]]...\n"
+		"                 [--iterations N] [--depth N]\n";
+}
+
+int main(int argc, char** argv)
+{
+	Options options;
+	for (int i = 1; i < argc; ++i)
+	{
+		std::string arg = argv[i];
+		if (i + 1 >= argc)
+		{
+			usage();
+			return 1;
+		}
+		const char* value = argv[++i];
+		if (arg == "--shape")
+		{
+			std::size_t k = 0;
+			while (k < sizeof(shapeNames) / sizeof(*shapeNames) && std::strcmp(shapeNames[k], value))
+				++k;
+			if (k == sizeof(shapeNames) / sizeof(*shapeNames))
+			{
+				usage();
+				return 1;
+			}
+			options.shapes.push_back(static_cast<Shape>(k));
+		}
+		else if (arg == "--size")
+			options.sizes.push_back(parseSize(value));
+		else if (arg == "--iterations")
+			options.iterations = std::strtoul(value, nullptr, 10);
+		else if (arg == "--depth")
+			options.depth = std::strtoul(value, nullptr, 10);
+		else
+		{
+			usage();
+			return 1;
+		}
+	}
+	if (options.shapes.empty())
+		options.shapes = { Shape::Deep, Shape::Wide, Shape::Attribute, Shape::Text, Shape::Entity, Shape::CDATA };
+	if (options.sizes.empty())
+		options.sizes = { 64 * 1024, 16 * 1024 * 1024 };
+
+	for (auto size : options.sizes)
+	{
+		for (auto shape : options.shapes)
+		{
+			auto corpus = generate(shape, size, options.depth);
+
+			std::size_t nodes = 0;
+			{
+				std::vector<char> buffer(corpus.begin(), corpus.end());
+				buffer.push_back(0);
+				XML::XMLParser parser;
+				CountHandler handler;
+				parser.parse<Flag::None>(buffer.data(), handler);
+				nodes = handler.nodes;
+			}
+
+			AllFlags::run(shapeNames[static_cast<int>(shape)], corpus, nodes, options);
+		}
+	}
+
+	return 0;
+}